@@ -1,8 +1,10 @@
 APP_NAME = CascadesParseQtSample
 
 CONFIG += qt warn_on cascades10
+QT += sql
 
 LIBS += -lbbdata
 LIBS += -lbbsystem
+LIBS += -lz
 
 include(config.pri)
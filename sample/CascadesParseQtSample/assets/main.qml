@@ -23,7 +23,6 @@ NavigationPane {
                 id: parse
                 applicationId: "GdU958QagMGpO8Z9PuW4miCWu22bFsVnUjqQ4lE5"
                 apiKey: "EbeFvVHANTbtIWeIfxbpp4w1Q343H8lfsxsJn857"
-                trace: true
             },
 
             // Create a ParseQuery object to retrieve the list of items stored in the
@@ -10,7 +10,18 @@ device {
                  $$quote($$BASEDIR/ParseQt_common/ParseError.cpp) \
                  $$quote($$BASEDIR/ParseQt_common/ParseObject.cpp) \
                  $$quote($$BASEDIR/ParseQt_common/ParseQuery.cpp) \
-                 $$quote($$BASEDIR/ParseQt_common/internal/ParseManager.cpp)
+                 $$quote($$BASEDIR/ParseQt_common/ParseQueryModel.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/ParseRows.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseBatch.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseCache.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseCompression.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseJournal.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseLocalStore.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseManager.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseMetrics.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseQueryEvaluator.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseScheduler.cpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseStreamReader.cpp)
 
         HEADERS +=  $$quote($$BASEDIR/src/applicationui.hpp) \
                  $$quote($$BASEDIR/ParseQt_cascades/ParseJson.hpp) \
@@ -18,7 +29,18 @@ device {
                  $$quote($$BASEDIR/ParseQt_common/ParseError.hpp) \
                  $$quote($$BASEDIR/ParseQt_common/ParseObject.hpp) \
                  $$quote($$BASEDIR/ParseQt_common/ParseQuery.hpp) \
-                 $$quote($$BASEDIR/ParseQt_common/internal/ParseManager.hpp)
+                 $$quote($$BASEDIR/ParseQt_common/ParseQueryModel.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/ParseRows.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseBatch.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseCache.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseCompression.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseJournal.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseLocalStore.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseManager.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseMetrics.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseQueryEvaluator.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseScheduler.hpp) \
+                 $$quote($$BASEDIR/ParseQt_common/internal/ParseStreamReader.hpp)
 
     }
 
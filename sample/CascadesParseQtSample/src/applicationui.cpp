@@ -9,6 +9,7 @@
 
 #include "Parse.hpp"
 #include "ParseQuery.hpp"
+#include "ParseQueryModel.hpp"
 #include "ParseObject.hpp"
 #include "ParseError.hpp"
 
@@ -24,6 +25,7 @@ ApplicationUI::ApplicationUI(bb::cascades::Application *app) : QObject(app)
 	qmlRegisterType<QDeclarativePropertyMap>("com.frameworklabs.parseqt", 1, 0, "PropertyMap");
 	qmlRegisterType<parseqt::Parse>("com.frameworklabs.parseqt", 1, 0, "Parse");
 	qmlRegisterType<parseqt::ParseQuery>("com.frameworklabs.parseqt", 1, 0, "ParseQuery");
+	qmlRegisterType<parseqt::ParseQueryModel>("com.frameworklabs.parseqt", 1, 0, "ParseQueryModel");
 	qmlRegisterType<parseqt::ParseObject>("com.frameworklabs.parseqt", 1, 0, "ParseObject");
 	qmlRegisterType<parseqt::ParseError>("com.frameworklabs.parseqt", 1, 0, "ParseError");
 
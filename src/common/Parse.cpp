@@ -34,6 +34,20 @@ QVariant ParseHelper::objectify(const QVariant &json, ParseError **error)
 	return QVariant();
 }
 
+static QList<ParseObject *> objectsFromVariant(const QVariant &objects)
+{
+	QList<ParseObject *> result;
+
+	foreach (const QVariant &variant, objects.toList()) {
+		ParseObject *object = qobject_cast<ParseObject *>(variant.value<QObject *>());
+		if (object) {
+			result.append(object);
+		}
+	}
+
+	return result;
+}
+
 ///
 
 Parse::Parse(QObject *parent) : QObject(parent)
@@ -42,6 +56,8 @@ Parse::Parse(QObject *parent) : QObject(parent)
 	if (!manager->delegate()) {
 		manager->setDelegate(new ParseHelper);
 	}
+
+	connect(manager->metrics(), SIGNAL(requestMeasured(const QVariantMap &)), this, SIGNAL(requestMeasured(const QVariantMap &)));
 }
 
 Parse::~Parse() { }
@@ -56,6 +72,7 @@ void Parse::setApplicationId(const QString &applicationId)
 	Q_ASSERT(!applicationId.isEmpty());
 
 	ParseManager::instance()->setApplicationId(applicationId);
+	ParseManager::instance()->journal()->scheduleFlush();
 }
 
 QString Parse::apiKey() const
@@ -68,16 +85,134 @@ void Parse::setApiKey(const QString &apiKey)
 	Q_ASSERT(!apiKey.isEmpty());
 
 	ParseManager::instance()->setApiKey(apiKey);
+	ParseManager::instance()->journal()->scheduleFlush();
 }
 
-bool Parse::trace() const
+QUrl Parse::serverUrl() const
 {
-	return ParseManager::instance()->trace();
+	return ParseManager::instance()->serverUrl();
+}
+
+void Parse::setServerUrl(const QUrl &serverUrl)
+{
+	Q_ASSERT(serverUrl.isValid());
+
+	ParseManager::instance()->setServerUrl(serverUrl);
 }
 
-void Parse::setTrace(bool trace)
+QString Parse::storageDirectory() const
 {
-	ParseManager::instance()->setTrace(trace);
+	return ParseManager::instance()->storageDirectory();
+}
+
+void Parse::setStorageDirectory(const QString &storageDirectory)
+{
+	Q_ASSERT(!storageDirectory.isEmpty());
+
+	ParseManager::instance()->setStorageDirectory(storageDirectory);
+}
+
+int Parse::cacheSize() const
+{
+	return ParseManager::instance()->cache()->maxSize();
+}
+
+void Parse::setCacheSize(int cacheSize)
+{
+	Q_ASSERT(cacheSize >= 0);
+
+	ParseManager::instance()->cache()->setMaxSize(cacheSize);
+}
+
+int Parse::maxConcurrentRequests() const
+{
+	return ParseManager::instance()->scheduler()->maxConcurrentRequests();
+}
+
+void Parse::setMaxConcurrentRequests(int maxConcurrentRequests)
+{
+	Q_ASSERT(maxConcurrentRequests > 0);
+
+	ParseManager::instance()->scheduler()->setMaxConcurrentRequests(maxConcurrentRequests);
+}
+
+double Parse::requestsPerSecond() const
+{
+	return ParseManager::instance()->scheduler()->requestsPerSecond();
+}
+
+void Parse::setRequestsPerSecond(double requestsPerSecond)
+{
+	Q_ASSERT(requestsPerSecond >= 0);
+
+	ParseManager::instance()->scheduler()->setRequestsPerSecond(requestsPerSecond);
+}
+
+int Parse::maxAttempts() const
+{
+	return ParseManager::instance()->scheduler()->retryPolicy().maxAttempts;
+}
+
+void Parse::setMaxAttempts(int maxAttempts)
+{
+	Q_ASSERT(maxAttempts > 0);
+
+	ParseScheduler *scheduler = ParseManager::instance()->scheduler();
+	ParseScheduler::RetryPolicy retryPolicy = scheduler->retryPolicy();
+	retryPolicy.maxAttempts = maxAttempts;
+	scheduler->setRetryPolicy(retryPolicy);
+}
+
+int Parse::requestTimeout() const
+{
+	return ParseManager::instance()->scheduler()->requestTimeout();
+}
+
+void Parse::setRequestTimeout(int requestTimeout)
+{
+	Q_ASSERT(requestTimeout >= 0);
+
+	ParseManager::instance()->scheduler()->setRequestTimeout(requestTimeout);
+}
+
+int Parse::compressionThreshold() const
+{
+	return ParseManager::instance()->compressionThreshold();
+}
+
+void Parse::setCompressionThreshold(int compressionThreshold)
+{
+	Q_ASSERT(compressionThreshold >= 0);
+
+	ParseManager::instance()->setCompressionThreshold(compressionThreshold);
+}
+
+QVariantMap Parse::metrics() const
+{
+	return ParseManager::instance()->metrics()->toVariant();
+}
+
+void Parse::resetMetrics()
+{
+	ParseManager::instance()->metrics()->reset();
+}
+
+int Parse::pendingWrites() const
+{
+	return ParseManager::instance()->journal()->pendingCount();
+}
+
+QVariantMap Parse::schedulerStatistics() const
+{
+	ParseScheduler *scheduler = ParseManager::instance()->scheduler();
+
+	QVariantMap result;
+	result.insert("queueDepth", scheduler->queueDepth());
+	result.insert("inFlight", scheduler->inFlight());
+	result.insert("dispatched", scheduler->dispatched());
+	result.insert("averageWaitTime", scheduler->dispatched() ? scheduler->totalWaitTime() / scheduler->dispatched() : 0);
+	result.insert("maxWaitTime", scheduler->maxWaitTime());
+	return result;
 }
 
 ParseObject *Parse::createObject()
@@ -85,6 +220,26 @@ ParseObject *Parse::createObject()
 	return new ParseObject;
 }
 
+void Parse::saveAll(const QVariant &objects)
+{
+	ParseObject::saveAll(objectsFromVariant(objects), this, SIGNAL(saveAllCompleted(bool, parseqt::ParseError *)));
+}
+
+void Parse::eraseAll(const QVariant &objects)
+{
+	ParseObject::eraseAll(objectsFromVariant(objects), this, SIGNAL(eraseAllCompleted(bool, parseqt::ParseError *)));
+}
+
+bool Parse::pinAll(const QVariant &objects)
+{
+	return ParseObject::pinAll(objectsFromVariant(objects));
+}
+
+bool Parse::unpinAll(const QVariant &objects)
+{
+	return ParseObject::unpinAll(objectsFromVariant(objects));
+}
+
 QDateTime Parse::dateTimeFromString(const QString &string)
 {
 	return ParseManager::dateTimeFromString(string);
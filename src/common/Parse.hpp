@@ -10,16 +10,26 @@
 
 #include <QDateTime>
 #include <QMetaType>
+#include <QUrl>
+#include <QVariant>
 
 namespace parseqt {
 
 class ParseObject;
+class ParseError;
 
 class Parse : public QObject {
 	Q_OBJECT
 	Q_PROPERTY(QString applicationId READ applicationId WRITE setApplicationId FINAL)
 	Q_PROPERTY(QString apiKey READ apiKey WRITE setApiKey FINAL)
-	Q_PROPERTY(bool trace READ trace WRITE setTrace FINAL)
+	Q_PROPERTY(QUrl serverUrl READ serverUrl WRITE setServerUrl FINAL)
+	Q_PROPERTY(QString storageDirectory READ storageDirectory WRITE setStorageDirectory FINAL)
+	Q_PROPERTY(int cacheSize READ cacheSize WRITE setCacheSize FINAL)
+	Q_PROPERTY(int maxConcurrentRequests READ maxConcurrentRequests WRITE setMaxConcurrentRequests FINAL)
+	Q_PROPERTY(double requestsPerSecond READ requestsPerSecond WRITE setRequestsPerSecond FINAL)
+	Q_PROPERTY(int maxAttempts READ maxAttempts WRITE setMaxAttempts FINAL)
+	Q_PROPERTY(int requestTimeout READ requestTimeout WRITE setRequestTimeout FINAL)
+	Q_PROPERTY(int compressionThreshold READ compressionThreshold WRITE setCompressionThreshold FINAL)
 
 public:
 	explicit Parse(QObject *parent = 0);
@@ -31,12 +41,62 @@ public:
 	QString apiKey() const;
 	void setApiKey(const QString &apiKey);
 
-	bool trace() const;
-	void setTrace(bool trace);
+	/// base url of the REST API, defaults to https://api.parse.com/1/
+	QUrl serverUrl() const;
+	void setServerUrl(const QUrl &serverUrl);
+
+	QString storageDirectory() const;
+	void setStorageDirectory(const QString &storageDirectory);
+
+	/// maximum size in bytes of the on-disk cache for query results
+	int cacheSize() const;
+	void setCacheSize(int cacheSize);
+
+	/// request scheduling - a requestsPerSecond of 0 disables rate limiting
+	int maxConcurrentRequests() const;
+	void setMaxConcurrentRequests(int maxConcurrentRequests);
+	double requestsPerSecond() const;
+	void setRequestsPerSecond(double requestsPerSecond);
+
+	/// retrying failed idempotent requests - maxAttempts of 1 disables retries, requestTimeout is
+	/// the time in ms a request may go without any upload or download progress, 0 disables it
+	int maxAttempts() const;
+	void setMaxAttempts(int maxAttempts);
+	int requestTimeout() const;
+	void setRequestTimeout(int requestTimeout);
+
+	/// request bodies of at least compressionThreshold bytes are sent gzip compressed, 0 disables compression
+	int compressionThreshold() const;
+	void setCompressionThreshold(int compressionThreshold);
+
+	/// queueDepth, inFlight, dispatched, averageWaitTime and maxWaitTime (in ms) of the scheduler
+	Q_INVOKABLE QVariantMap schedulerStatistics() const;
+
+	/// request metrics by "<operation> <className>" (e.g. "GET Item"), each with the number of requests and failures
+	/// and histograms for queueTime, firstByteTime, transferTime, decodeTime, objectifyTime (in ms), requestBytes and
+	/// responseBytes; a histogram has count, sum, min, max, mean and buckets as a list of {le: upper bound, count}
+	Q_INVOKABLE QVariantMap metrics() const;
+	Q_INVOKABLE void resetMetrics();
+
+	/// emitted with the measurements of every finished request
+	Q_SIGNAL void requestMeasured(const QVariantMap &sample);
+
+	/// number of saveEventually and eraseEventually writes not yet sent
+	Q_INVOKABLE int pendingWrites() const;
 
 public: // factories
 	Q_INVOKABLE parseqt::ParseObject *createObject();
 
+public: // batch operations on lists of ParseObjects
+	Q_INVOKABLE void saveAll(const QVariant &objects);
+	Q_SIGNAL void saveAllCompleted(bool succeeded, parseqt::ParseError *error);
+
+	Q_INVOKABLE void eraseAll(const QVariant &objects);
+	Q_SIGNAL void eraseAllCompleted(bool succeeded, parseqt::ParseError *error);
+
+	Q_INVOKABLE bool pinAll(const QVariant &objects);
+	Q_INVOKABLE bool unpinAll(const QVariant &objects);
+
 public: // quasi-static helpers
 	Q_INVOKABLE QDateTime dateTimeFromString(const QString &string);
 	Q_INVOKABLE QString stringFromDateTime(const QDateTime &dateTime);
@@ -35,7 +35,9 @@ public:
 	enum ParseCode {
 		ParseCodeInternalServerError = 1,
 		ParseCodeConnectionFailed = 100,
-		ParseCodeObjectNotFound = 101
+		ParseCodeObjectNotFound = 101,
+		ParseCodeCacheMiss = 120,
+		ParseCodeRequestLimitExceeded = 155
 	};
 
 	enum JsonCode {
@@ -45,7 +47,10 @@ public:
 	enum ParseQt {
 		ParseQtInternal = 1,
 		ParseQtNotInitialized = 2,
-		ParseQtInvalidType = 3
+		ParseQtInvalidType = 3,
+		ParseQtInvalidEncoding = 4,
+		ParseQtDatabase = 5,
+		ParseQtStorage = 6
 	};
 
 	explicit ParseError(QObject *parent = 0);
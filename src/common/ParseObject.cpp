@@ -8,6 +8,8 @@
 #include "ParseObject.hpp"
 
 #include "internal/ParseManager.hpp"
+#include "internal/ParseBatch.hpp"
+#include "internal/ParseJournal.hpp"
 #include "ParseError.hpp"
 
 #include <QtNetwork/QNetworkReply>
@@ -16,51 +18,18 @@
 
 namespace parseqt {
 
-static QVariantMap filterJsonMap(const QVariantMap &map)
+static bool isReservedKey(const QString &key)
 {
-	QVariantMap result = map;
-
-	result.remove("objectId");
-	result.remove("createdAt");
-	result.remove("updatedAt");
-	result.remove("valueOf"); // this gets added by QDeclarativePropertyMap for some reason
-
-	return result;
+	return key == "objectId" || key == "createdAt" || key == "updatedAt"
+			|| key == "valueOf"; // this gets added by QDeclarativePropertyMap for some reason
 }
 
-static QVariantMap mergeJsonMap(const QVariantMap &base, const QVariantMap &other)
+ParseObject::ParseObject(QObject *parent) : QObject(parent), _partial(false), _busy(false), _retries(0)
 {
-	QVariantMap result = base;
-
-	QMapIterator<QString, QVariant> i(other);
-	while (i.hasNext()) {
-		i.next();
-		result.insert(i.key(), i.value());
-	}
-
-	return result;
-}
-
-static QVariantMap diffJsonMap(const QVariantMap &base, const QVariantMap &other)
-{
-	QVariantMap result;
-
-	QMapIterator<QString, QVariant> i(other);
-	while (i.hasNext()) {
-		i.next();
-		QString key = i.key();
-		QVariant baseValue = base.value(key);
-		QVariant otherValue = other.value(key);
-		if (baseValue != otherValue) {
-			result.insert(key, otherValue);
-		}
-	}
-
-	return result;
+	// assignments from QML are reported by the map, assignments from C++ should go through setValue
+	connect(&_data, SIGNAL(valueChanged(const QString &, const QVariant &)), this, SLOT(dataValueChanged(const QString &)));
 }
 
-ParseObject::ParseObject(QObject *parent) : QObject(parent), _busy(false) { }
-
 ParseObject::~ParseObject() { }
 
 QString ParseObject::className() const
@@ -80,17 +49,48 @@ QDeclarativePropertyMap *ParseObject::data()
 
 QString ParseObject::objectId() const
 {
-	return _snapshot.value("objectId").toString();
+	return _objectId;
 }
 
 QDateTime ParseObject::createdAt() const
 {
-	return ParseManager::dateTimeFromString(_snapshot.value("createdAt").toString());
+	return _createdAt;
 }
 
 QDateTime ParseObject::updatedAt() const
 {
-	return ParseManager::dateTimeFromString(_snapshot.value("updatedAt").toString());
+	return _updatedAt;
+}
+
+QVariant ParseObject::value(const QString &key) const
+{
+	return _data.value(key);
+}
+
+void ParseObject::setValue(const QString &key, const QVariant &value)
+{
+	_data.insert(key, value);
+	_dirtyKeys.insert(key);
+}
+
+bool ParseObject::isDirty(const QString &key) const
+{
+	return _dirtyKeys.contains(key);
+}
+
+QStringList ParseObject::dirtyKeys() const
+{
+	return _dirtyKeys.toList();
+}
+
+bool ParseObject::partial() const
+{
+	return _partial;
+}
+
+void ParseObject::setPartial(bool partial)
+{
+	_partial = partial;
 }
 
 bool ParseObject::busy() const
@@ -98,6 +98,11 @@ bool ParseObject::busy() const
 	return _busy;
 }
 
+int ParseObject::retries() const
+{
+	return _retries;
+}
+
 void ParseObject::save()
 {
 	Q_ASSERT(!_className.isEmpty());
@@ -106,6 +111,8 @@ void ParseObject::save()
 		return;
 	}
 	setBusy(true);
+	_retries = 0;
+	beginSave();
 
 	if (objectId().isEmpty()) {
 		createObject();
@@ -123,6 +130,7 @@ void ParseObject::erase()
 		return;
 	}
 	setBusy(true);
+	_retries = 0;
 
 	ParseError *error = ParseManager::instance()->request(QNetworkAccessManager::DeleteOperation,
 											"classes/" + _className + "/" + objectId(),
@@ -142,111 +150,300 @@ void ParseObject::eraseFinished()
 	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
 	reply->deleteLater();
 
-	setBusy(false);
+	_retries = ParseScheduler::retries(reply);
 
 	ParseError *error = NULL;
-	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
 
+	completeErase(error);
 	if (error) {
-		Q_EMIT eraseCompleted(false, error);
+		error->deleteLater();
+	}
+}
+
+void ParseObject::saveAll(const QList<ParseObject *> &objects, QObject *receiver, const char *slot)
+{
+	ParseBatch *batch = new ParseBatch(ParseBatch::ActionSave, objects);
+	if (receiver && slot) {
+		QObject::connect(batch, SIGNAL(completed(bool, parseqt::ParseError *)), receiver, slot);
+	}
+	batch->start();
+}
+
+void ParseObject::eraseAll(const QList<ParseObject *> &objects, QObject *receiver, const char *slot)
+{
+	ParseBatch *batch = new ParseBatch(ParseBatch::ActionErase, objects);
+	if (receiver && slot) {
+		QObject::connect(batch, SIGNAL(completed(bool, parseqt::ParseError *)), receiver, slot);
+	}
+	batch->start();
+}
+
+void ParseObject::saveEventually()
+{
+	Q_ASSERT(!_className.isEmpty());
+
+	// the journal merges this write into a queued one, so the dirty keys are handed over right away
+	ParseError *error = NULL;
+	bool creating = objectId().isEmpty() && _localId.isEmpty();
+	checkUntrackedWrites();
+	QVariant json = creating ? createJson(&error) : toJson(_dirtyKeys.toList(), &error);
+
+	if (!error) {
+		error = ParseManager::instance()->journal()->enqueue(this, ParseJournal::ActionSave, json.toMap());
+	}
+
+	if (error) {
+		Q_EMIT saveCompleted(false, error);
 		error->deleteLater();
 		return;
 	}
+	_dirtyKeys.clear();
+}
 
-	setData(QVariantMap());
+void ParseObject::eraseEventually()
+{
+	Q_ASSERT(!_className.isEmpty());
 
-	Q_EMIT eraseCompleted(true, NULL);
+	if (objectId().isEmpty() && _localId.isEmpty()) {
+		// nothing to delete on the server
+		Q_EMIT eraseCompleted(true, NULL);
+		return;
+	}
+
+	ParseError *error = ParseManager::instance()->journal()->enqueue(this, ParseJournal::ActionErase, QVariantMap());
+	if (error) {
+		Q_EMIT eraseCompleted(false, error);
+		error->deleteLater();
+	}
 }
 
-ParseError *ParseObject::setData(const QVariantMap &jsonMap)
+bool ParseObject::pin()
 {
-	bool changedData = false;
-	bool changedObjectId = false;
-	bool changedCreatedAt = false;
-	bool changedUpdatedAt = false;
+	return pinAll(QList<ParseObject *>() << this);
+}
 
-	if (_snapshot != jsonMap) {
-		changedData = true;
+bool ParseObject::unpin()
+{
+	return unpinAll(QList<ParseObject *>() << this);
+}
+
+bool ParseObject::pinAll(const QList<ParseObject *> &objects)
+{
+	// one transaction per class
+	QMap<QString, QVariantList> jsonObjects;
+	ParseError *error = NULL;
+
+	foreach (ParseObject *object, objects) {
+		Q_ASSERT(!object->className().isEmpty());
+
+		if (object->objectId().isEmpty()) {
+			qWarning() << "ParseObject: can't pin an object without objectId";
+			return false;
+		}
+
+		QVariant json = object->storedJson(&error);
+		if (error) {
+			break;
+		}
+		jsonObjects[object->className()].append(json);
 	}
-	if (_snapshot.value("objectId") != jsonMap.value("objectId")) {
-		changedObjectId = true;
+
+	ParseLocalStore *store = ParseManager::instance()->localStore();
+	for (QMap<QString, QVariantList>::const_iterator i = jsonObjects.constBegin(); !error && i != jsonObjects.constEnd(); ++i) {
+		store->insert(i.key(), i.value(), &error);
 	}
-	if (_snapshot.value("createdAt") != jsonMap.value("createdAt")) {
-		changedCreatedAt = true;
+
+	if (error) {
+		qWarning() << "ParseObject: pinning failed:" << error->error();
+		delete error;
+		return false;
 	}
-	if (_snapshot.value("updatedAt") != jsonMap.value("updatedAt")) {
-		changedUpdatedAt = true;
+	return true;
+}
+
+bool ParseObject::unpinAll(const QList<ParseObject *> &objects)
+{
+	QMap<QString, QStringList> objectIds;
+	foreach (ParseObject *object, objects) {
+		if (!object->objectId().isEmpty()) {
+			objectIds[object->className()].append(object->objectId());
+		}
+	}
+
+	ParseError *error = NULL;
+	ParseLocalStore *store = ParseManager::instance()->localStore();
+	for (QMap<QString, QStringList>::const_iterator i = objectIds.constBegin(); !error && i != objectIds.constEnd(); ++i) {
+		store->remove(i.key(), i.value(), &error);
 	}
 
-	ParseError *error = fromJsonMap(jsonMap);
 	if (error) {
-		return error;
+		qWarning() << "ParseObject: unpinning failed:" << error->error();
+		delete error;
+		return false;
 	}
-	_snapshot = jsonMap;
+	return true;
+}
+
+ParseError *ParseObject::setData(const QVariantMap &jsonMap, bool keepChanges)
+{
+	bool changedData = false;
+	ParseError *error = NULL;
+	ParseManager *manager = ParseManager::instance();
+
+	for (QVariantMap::const_iterator i = jsonMap.constBegin(); i != jsonMap.constEnd(); ++i) {
+		// local changes not saved yet win over fetched values
+		if (keepChanges && (_dirtyKeys.contains(i.key()) || _savingKeys.contains(i.key()))) {
+			continue;
+		}
+
+		QVariant data = manager->objectify(i.value(), &error);
+		if (error) {
+			return error;
+		}
+		if (_data.value(i.key()) != data) {
+			_data.insert(i.key(), data);
+			changedData = true;
+		}
+#ifndef QT_NO_DEBUG
+		_synced.insert(i.key(), data);
+#endif
+
+		// the value now matches the server's
+		_dirtyKeys.remove(i.key());
+	}
+
+	// timestamps are parsed once here rather than on every property read
+	QVariantMap::const_iterator createdAt = jsonMap.constFind("createdAt");
+	QVariantMap::const_iterator updatedAt = jsonMap.constFind("updatedAt");
+	setMetadata(jsonMap.value("objectId", _objectId).toString(),
+				createdAt != jsonMap.constEnd() ? ParseManager::dateTimeFromString(createdAt.value().toString()) : _createdAt,
+				updatedAt != jsonMap.constEnd() ? ParseManager::dateTimeFromString(updatedAt.value().toString()) : _updatedAt);
 
 	if (changedData) {
 		Q_EMIT dataChanged();
 	}
-	if (changedObjectId) {
+
+	return NULL;
+}
+
+ParseObject *ParseObject::objectFromJson(const QString &className, const QVariantMap &jsonMap, bool partial)
+{
+	// the object may already be loaded, e.g. by another query
+	ParseObject *result = ParseManager::instance()->registeredObject(className, jsonMap.value("objectId").toString());
+	if (result) {
+		result->mergeFetched(jsonMap, partial);
+		return result;
+	}
+
+	result = new ParseObject();
+	result->setClassName(className);
+	result->setPartial(partial);
+	ParseError *error = result->setData(jsonMap);
+	delete error;
+
+	return result;
+}
+
+void ParseObject::mergeFetched(const QVariantMap &jsonMap, bool partial)
+{
+	// a reply older than the data at hand doesn't roll it back
+	QVariantMap::const_iterator updatedAt = jsonMap.constFind("updatedAt");
+	if (updatedAt != jsonMap.constEnd() && _updatedAt.isValid()
+			&& ParseManager::dateTimeFromString(updatedAt.value().toString()) < _updatedAt) {
+		return;
+	}
+
+	ParseError *error = setData(jsonMap, true);
+	delete error;
+
+	if (!partial) {
+		setPartial(false);
+	}
+}
+
+void ParseObject::setMetadata(const QString &objectId, const QDateTime &createdAt, const QDateTime &updatedAt)
+{
+	if (objectId != _objectId) {
+		ParseManager *manager = ParseManager::instance();
+		if (!_objectId.isEmpty()) {
+			manager->unregisterObject(_className, _objectId, this);
+		}
+		_objectId = objectId;
+		if (!_objectId.isEmpty() && !manager->registeredObject(_className, _objectId)) {
+			manager->registerObject(this);
+		}
 		Q_EMIT objectIdChanged();
 	}
-	if (changedCreatedAt) {
+	if (createdAt != _createdAt) {
+		_createdAt = createdAt;
 		Q_EMIT createdAtChanged();
 	}
-	if (changedUpdatedAt) {
+	if (updatedAt != _updatedAt) {
+		_updatedAt = updatedAt;
 		Q_EMIT updatedAtChanged();
 	}
-
-	return NULL;
 }
 
-QVariant ParseObject::toJson(ParseError **error) const
+void ParseObject::dataValueChanged(const QString &key)
 {
-	Q_ASSERT(error);
-
-	QVariantMap result;
-	ParseManager *manager = ParseManager::instance();
+	_dirtyKeys.insert(key);
+}
 
+void ParseObject::checkUntrackedWrites()
+{
+#ifndef QT_NO_DEBUG
+	// the map doesn't report inserts from C++, so such writes would be lost silently in release builds,
+	// except on creation which sends all keys
+	bool creating = _objectId.isEmpty() && _localId.isEmpty();
 	foreach (const QString &key, _data.keys()) {
-		result.insert(key, manager->jsonify(_data.value(key), error));
+		QVariant value = _data.value(key);
+		if (!creating && !isReservedKey(key) && !_dirtyKeys.contains(key) && !_savingKeys.contains(key) && value != _synced.value(key)) {
+			qWarning() << "ParseObject: value of" << key << "was written to data() without setValue, it won't be saved";
+			Q_ASSERT_X(false, "ParseObject", "value written to data() without setValue");
+		}
+		_synced.insert(key, value);
 	}
-
-	return result;
+#endif
 }
 
-ParseError *ParseObject::fromJsonMap(const QVariantMap &jsonMap)
+QVariant ParseObject::toJson(const QStringList &keys, ParseError **error) const
 {
-	ParseError *error = NULL;
+	Q_ASSERT(error);
+
+	QVariantMap result;
 	ParseManager *manager = ParseManager::instance();
 
-	foreach (const QString &key, jsonMap.keys()) {
-		QVariant data = manager->objectify(jsonMap.value(key), &error);
-		if (!data.isValid()) {
-			return error;
+	foreach (const QString &key, keys) {
+		if (isReservedKey(key)) {
+			continue;
+		}
+
+		QVariant json = manager->jsonify(_data.value(key), error);
+		if (*error) {
+			return QVariant();
 		}
-		_data.insert(key, data);
+		result.insert(key, json);
 	}
 
-	return NULL;
+	return result;
 }
 
 void ParseObject::createObject()
 {
 	ParseError *error = NULL;
 
-	QVariant json = toJson(&error);
+	QVariant json = createJson(&error);
 
 	if (json.isValid()) {
 		error = ParseManager::instance()->request(QNetworkAccessManager::PostOperation,
 								   	      	  	  "classes/" + _className,
-								   	      	  	  filterJsonMap(json.toMap()),
+								   	      	  	  json,
 								   	      	  	  this, SLOT(createObjectFinished()));
 	}
 
 	if (error) {
-		setBusy(false);
-
-		Q_EMIT saveCompleted(false, error);
+		completeSave(QVariantMap(), error);
 		error->deleteLater();
 	}
 }
@@ -256,43 +453,32 @@ void ParseObject::createObjectFinished()
 	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
 	reply->deleteLater();
 
-	setBusy(false);
+	_retries = ParseScheduler::retries(reply);
 
 	ParseError *error = NULL;
-	QVariant oldJson = toJson(&error);
-	QVariant newJson;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 201, &error);
 
-	if (oldJson.isValid()) {
-		newJson = ParseManager::instance()->retrieveJsonReply(reply, 201, &error);
-	}
-
-	if (!newJson.isValid()) {
-		Q_EMIT saveCompleted(false, error);
+	completeSave(json.toMap(), error);
+	if (error) {
 		error->deleteLater();
-		return;
 	}
-
-	setData(mergeJsonMap(filterJsonMap(oldJson.toMap()), newJson.toMap()));
-	Q_EMIT saveCompleted(true, NULL);
 }
 
 void ParseObject::updateObject()
 {
 	ParseError *error = NULL;
 
-	QVariant json = toJson(&error);
+	QVariant json = updateJson(&error);
 
 	if (json.isValid()) {
 		error = ParseManager::instance()->request(QNetworkAccessManager::PutOperation,
 								   	      	  	  	      "classes/" + _className + "/" + objectId(),
-								   	      	  	  	      diffJsonMap(filterJsonMap(_snapshot), filterJsonMap(json.toMap())),
+								   	      	  	  	      json,
 								   	      	  	  	      this, SLOT(updateObjectFinished()));
 	}
 
 	if (error) {
-		setBusy(false);
-
-		Q_EMIT saveCompleted(false, error);
+		completeSave(QVariantMap(), error);
 		error->deleteLater();
 	}
 }
@@ -302,26 +488,152 @@ void ParseObject::updateObjectFinished()
 	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
 	reply->deleteLater();
 
-	setBusy(false);
+	_retries = ParseScheduler::retries(reply);
 
 	ParseError *error = NULL;
-	QVariant oldJson = toJson(&error);
-	QVariant newJson;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
 
-	if (oldJson.isValid()) {
-		 newJson = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	completeSave(json.toMap(), error);
+	if (error) {
+		error->deleteLater();
 	}
+}
+
+QVariant ParseObject::createJson(ParseError **error) const
+{
+	return toJson(_data.keys(), error);
+}
+
+QVariant ParseObject::updateJson(ParseError **error) const
+{
+	return toJson(_savingKeys.toList(), error);
+}
+
+QVariant ParseObject::storedJson(ParseError **error) const
+{
+	// as the server would return it
+	QVariantMap json = createJson(error).toMap();
+	json.insert("objectId", _objectId);
+	json.insert("createdAt", ParseManager::stringFromDateTime(_createdAt));
+	json.insert("updatedAt", ParseManager::stringFromDateTime(_updatedAt));
 
-	if (!newJson.isValid()) {
+	return json;
+}
+
+QVariant ParseObject::saveRequest(ParseError **error)
+{
+	beginSave();
+
+	QVariantMap request;
+	QVariant body;
+
+	if (objectId().isEmpty()) {
+		request.insert("method", "POST");
+		request.insert("path", ParseManager::instance()->batchPath("classes/" + _className));
+		body = createJson(error);
+	}
+	else {
+		request.insert("method", "PUT");
+		request.insert("path", ParseManager::instance()->batchPath("classes/" + _className + "/" + objectId()));
+		body = updateJson(error);
+	}
+
+	if (!body.isValid()) {
+		return QVariant();
+	}
+	request.insert("body", body);
+
+	return request;
+}
+
+QVariant ParseObject::eraseRequest() const
+{
+	QVariantMap request;
+	request.insert("method", "DELETE");
+	request.insert("path", ParseManager::instance()->batchPath("classes/" + _className + "/" + objectId()));
+
+	return request;
+}
+
+void ParseObject::beginSave()
+{
+	checkUntrackedWrites();
+
+	// keys changed while the save is in flight stay dirty
+	_savingKeys += _dirtyKeys;
+	_dirtyKeys.clear();
+}
+
+void ParseObject::endSave(bool succeeded)
+{
+	if (!succeeded) {
+		_dirtyKeys += _savingKeys;
+	}
+	_savingKeys.clear();
+}
+
+void ParseObject::completeSave(const QVariantMap &json, ParseError *error)
+{
+	setBusy(false);
+	endSave(!error);
+
+	ParseError *mergeError = NULL;
+	if (!error) {
+		error = mergeError = mergeSaveReply(json);
+	}
+
+	if (error) {
 		Q_EMIT saveCompleted(false, error);
-		error->deleteLater();
+		if (mergeError) {
+			mergeError->deleteLater();
+		}
 		return;
 	}
 
-	setData(mergeJsonMap(_snapshot, mergeJsonMap(filterJsonMap(oldJson.toMap()), newJson.toMap())));
 	Q_EMIT saveCompleted(true, NULL);
 }
 
+void ParseObject::completeErase(ParseError *error)
+{
+	setBusy(false);
+
+	if (error) {
+		Q_EMIT eraseCompleted(false, error);
+		return;
+	}
+
+	setMetadata(QString(), QDateTime(), QDateTime());
+
+	Q_EMIT eraseCompleted(true, NULL);
+}
+
+void ParseObject::completeEventually(bool erased, const QVariantMap &json, ParseError *error)
+{
+	if (erased) {
+		if (!error) {
+			_localId.clear();
+			setMetadata(QString(), QDateTime(), QDateTime());
+		}
+		Q_EMIT eraseCompleted(!error, error);
+		return;
+	}
+
+	ParseError *mergeError = NULL;
+	if (!error) {
+		error = mergeError = mergeSaveReply(json);
+	}
+
+	Q_EMIT saveCompleted(!error, error);
+	if (mergeError) {
+		mergeError->deleteLater();
+	}
+}
+
+ParseError *ParseObject::mergeSaveReply(const QVariantMap &json)
+{
+	return setData(json);
+}
+
 void ParseObject::setBusy(bool busy)
 {
 	if (busy != _busy) {
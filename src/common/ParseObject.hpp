@@ -9,6 +9,8 @@
 #define PARSEQT__PARSE_OBJECT_HPP_
 
 #include <QDateTime>
+#include <QSet>
+#include <QStringList>
 #include <QtDeclarative/qdeclarativepropertymap.h>
 
 namespace parseqt {
@@ -23,7 +25,9 @@ class ParseObject : public QObject {
 	Q_PROPERTY(QString objectId READ objectId NOTIFY objectIdChanged FINAL)
 	Q_PROPERTY(QDateTime createdAt READ createdAt NOTIFY createdAtChanged FINAL)
 	Q_PROPERTY(QDateTime updatedAt READ updatedAt NOTIFY updatedAtChanged FINAL)
+	Q_PROPERTY(bool partial READ partial FINAL)
 	Q_PROPERTY(bool busy READ busy NOTIFY busyChanged FINAL)
+	Q_PROPERTY(int retries READ retries FINAL)
 
 public:
 	/// creating objects
@@ -39,8 +43,24 @@ public:
 	QDateTime createdAt() const;
 	QDateTime updatedAt() const;
 
+	/// reading and writing values - writes from C++ must use setValue to be picked up by the next save,
+	/// debug builds assert when a save finds a value which was inserted into data() directly
+	Q_INVOKABLE QVariant value(const QString &key) const;
+	Q_INVOKABLE void setValue(const QString &key, const QVariant &value);
+
+	/// keys changed since the last fetch or save
+	Q_INVOKABLE bool isDirty(const QString &key) const;
+	Q_INVOKABLE QStringList dirtyKeys() const;
+
+	/// partial objects were fetched with selected keys only - saving them sends only the changed
+	/// keys, so the keys which were not fetched are left untouched on the server
+	bool partial() const;
+
 	bool busy() const;
 
+	/// number of retries needed by the last save or erase, valid when its completion signal is emitted
+	int retries() const;
+
 	/// saving an object
 	Q_INVOKABLE void save();
 	Q_SIGNAL void saveCompleted(bool succeeded, parseqt::ParseError *error);
@@ -49,6 +69,26 @@ public:
 	Q_INVOKABLE void erase();
 	Q_SIGNAL void eraseCompleted(bool succeeded, parseqt::ParseError *error);
 
+	/// saving and deleting many objects in as few requests as possible (via the batch endpoint)
+	/// each object reports its result through saveCompleted/eraseCompleted; the optional receiver's slot
+	/// with signature (bool succeeded, parseqt::ParseError *error) is called once all objects are done
+	static void saveAll(const QList<ParseObject *> &objects, QObject *receiver = 0, const char *slot = 0);
+	static void eraseAll(const QList<ParseObject *> &objects, QObject *receiver = 0, const char *slot = 0);
+
+	/// saving and deleting when the network allows - the write is journaled on disk right away and
+	/// sent, also after a restart, once online; saveCompleted/eraseCompleted are emitted when sent
+	/// while the object is still alive, or right away with an error if the journal can't be written.
+	/// Objects created this way get their objectId once sent.
+	Q_INVOKABLE void saveEventually();
+	Q_INVOKABLE void eraseEventually();
+
+	/// keeping objects in the local datastore, for queries using fromLocalDatastore - pinning stores
+	/// the current data and replaces what was pinned before, only objects with an objectId can be pinned
+	Q_INVOKABLE bool pin();
+	Q_INVOKABLE bool unpin();
+	static bool pinAll(const QList<ParseObject *> &objects);
+	static bool unpinAll(const QList<ParseObject *> &objects);
+
 Q_SIGNALS:
 	void dataChanged();
 	void objectIdChanged();
@@ -58,14 +98,38 @@ Q_SIGNALS:
 
 private:
 	friend class ParseQuery;
+	friend class ParseBatch;
+	friend class ParseJournal;
+	friend class ParseRows;
 
-	ParseError *setData(const QVariantMap &jsonMap);
+	ParseError *setData(const QVariantMap &jsonMap, bool keepChanges = false);
+	void setPartial(bool partial);
+	void mergeFetched(const QVariantMap &jsonMap, bool partial);
+
+	/// the live object with the objectId of jsonMap updated by it, or a new object
+	static ParseObject *objectFromJson(const QString &className, const QVariantMap &jsonMap, bool partial);
 
 private:
 	Q_DISABLE_COPY(ParseObject)
 
-	QVariant toJson(ParseError **error) const;
-	ParseError *fromJsonMap(const QVariantMap &jsonMap);
+	void setMetadata(const QString &objectId, const QDateTime &createdAt, const QDateTime &updatedAt);
+	Q_SLOT void dataValueChanged(const QString &key);
+	void checkUntrackedWrites();
+
+	QVariant toJson(const QStringList &keys, ParseError **error) const;
+	QVariant createJson(ParseError **error) const;
+	QVariant updateJson(ParseError **error) const;
+	QVariant storedJson(ParseError **error) const;
+
+	QVariant saveRequest(ParseError **error);
+	QVariant eraseRequest() const;
+
+	void beginSave();
+	void endSave(bool succeeded);
+	void completeSave(const QVariantMap &json, ParseError *error);
+	void completeErase(ParseError *error);
+	void completeEventually(bool erased, const QVariantMap &json, ParseError *error);
+	ParseError *mergeSaveReply(const QVariantMap &json);
 
 	void createObject();
 	Q_SLOT void createObjectFinished();
@@ -80,8 +144,18 @@ private:
 private:
 	QString _className;
 	QDeclarativePropertyMap _data;
-	QVariantMap _snapshot;
+	QString _objectId;
+	QString _localId; // identifies an object created by saveEventually until it has an objectId
+	QDateTime _createdAt;
+	QDateTime _updatedAt;
+	QSet<QString> _dirtyKeys;
+	QSet<QString> _savingKeys; // dirty keys of the save in flight
+#ifndef QT_NO_DEBUG
+	QVariantMap _synced; // values as last fetched or saved, to catch writes which bypass setValue
+#endif
+	bool _partial;
 	bool _busy;
+	int _retries;
 };
 
 } /* namespace parseqt */
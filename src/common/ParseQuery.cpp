@@ -8,7 +8,10 @@
 #include "ParseQuery.hpp"
 
 #include "ParseObject.hpp"
+#include "ParseRows.hpp"
 #include "internal/ParseManager.hpp"
+#include "internal/ParseQueryEvaluator.hpp"
+#include "internal/ParseStreamReader.hpp"
 #include "ParseError.hpp"
 #include "ParseJson.hpp"
 
@@ -16,11 +19,32 @@
 
 #include <QDebug>
 
+#define PQ_QUERY_MAX_LIMIT	1000 // maximum number of results the server returns per request
+#define PQ_QUERY_DEFAULT_PARALLELISM	4
+
 namespace parseqt {
 
-ParseQuery::ParseQuery(QObject *parent) : QObject(parent), _limit(-1), _skip(0) { }
+/// objects come as ParseObject * from C++ and as QObject * from QML
+static ParseObject *objectFromVariant(const QVariant &variant)
+{
+	ParseObject *object = variant.value<ParseObject *>();
+	return object ? object : qobject_cast<ParseObject *>(variant.value<QObject *>());
+}
+
+ParseQuery::ParseQuery(QObject *parent)
+	: QObject(parent), _limit(-1), _skip(0), _busy(false), _streaming(false), _lazyResults(false), _localDatastore(false), _sync(false), _reader(NULL), _streamError(NULL),
+	  _cachePolicy(IgnoreCache), _maxCacheAge(0), _retries(0), _findAllCount(0), _findAllPaused(false),
+	  _findAllPending(false), _findAllCancelled(false), _parallelism(PQ_QUERY_DEFAULT_PARALLELISM), _ordered(true),
+	  _parallelPages(0), _parallelNextPage(0), _parallelNextEmit(0), _parallelInFlight(0), _parallelError(NULL)
+{
+}
 
-ParseQuery::~ParseQuery() { }
+ParseQuery::~ParseQuery()
+{
+	delete _reader;
+	delete _streamError;
+	delete _parallelError;
+}
 
 QString ParseQuery::className() const
 {
@@ -37,6 +61,11 @@ bool ParseQuery::busy() const
 	return _busy;
 }
 
+int ParseQuery::retries() const
+{
+	return _retries;
+}
+
 void ParseQuery::getObjectById(const QString &objectId)
 {
 	Q_ASSERT(!_className.isEmpty());
@@ -45,10 +74,16 @@ void ParseQuery::getObjectById(const QString &objectId)
 		return;
 	}
 	setBusy(true);
+	_retries = 0;
+
+	if (_localDatastore) {
+		getLocalObjectById(objectId);
+		return;
+	}
 
 	ParseError *error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
 								   	      	  	  	      "classes/" + _className + "/" + objectId,
-								   	      	  	  	      QVariant(),
+								   	      	  	  	      QVariant(keysConstraint()),
 								   	      	  	  	      this, SLOT(getObjectByIdFinished()));
 
 	if (error) {
@@ -64,6 +99,8 @@ void ParseQuery::getObjectByIdFinished()
 	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
 	reply->deleteLater();
 
+	_retries = ParseScheduler::retries(reply);
+
 	setBusy(false);
 
 	ParseError *error = NULL;
@@ -74,9 +111,10 @@ void ParseQuery::getObjectByIdFinished()
 		return;
 	}
 
-	ParseObject *result = new ParseObject();
-	result->setClassName(_className);
-	result->setData(json.toMap());
+	QElapsedTimer timer;
+	timer.start();
+	ParseObject *result = objectFromJson(json.toMap());
+	ParseRequestMetrics::addObjectifyTime(reply, timer);
 
 	Q_EMIT getObjectByIdCompleted(result, NULL);
 }
@@ -128,6 +166,16 @@ void ParseQuery::addDescendingOrder(const QString &key)
 	addOrder(key, Qt::DescendingOrder);
 }
 
+void ParseQuery::selectKeys(const QStringList &keys)
+{
+	_selectedKeys = keys;
+}
+
+QStringList ParseQuery::selectedKeys() const
+{
+	return _selectedKeys;
+}
+
 int ParseQuery::limit() const
 {
 	return _limit;
@@ -152,6 +200,103 @@ void ParseQuery::setSkip(int skip)
 	_skip = skip;
 }
 
+bool ParseQuery::streaming() const
+{
+	return _streaming;
+}
+
+void ParseQuery::setStreaming(bool streaming)
+{
+	_streaming = streaming;
+}
+
+bool ParseQuery::lazyResults() const
+{
+	return _lazyResults;
+}
+
+void ParseQuery::setLazyResults(bool lazyResults)
+{
+	_lazyResults = lazyResults;
+}
+
+void ParseQuery::fromLocalDatastore()
+{
+	_localDatastore = true;
+}
+
+bool ParseQuery::localDatastore() const
+{
+	return _localDatastore;
+}
+
+void ParseQuery::setLocalDatastore(bool localDatastore)
+{
+	_localDatastore = localDatastore;
+}
+
+bool ParseQuery::sync() const
+{
+	return _sync;
+}
+
+void ParseQuery::setSync(bool sync)
+{
+	_sync = sync;
+}
+
+ParseQuery::CachePolicy ParseQuery::cachePolicy() const
+{
+	return _cachePolicy;
+}
+
+void ParseQuery::setCachePolicy(CachePolicy cachePolicy)
+{
+	_cachePolicy = cachePolicy;
+}
+
+int ParseQuery::maxCacheAge() const
+{
+	return _maxCacheAge;
+}
+
+void ParseQuery::setMaxCacheAge(int maxCacheAge)
+{
+	Q_ASSERT(maxCacheAge >= 0);
+
+	_maxCacheAge = maxCacheAge;
+}
+
+bool ParseQuery::hasCachedResult()
+{
+	ParseError *error = NULL;
+	QVariant data(cacheConstraints(&error));
+	if (!data.isValid()) {
+		delete error;
+		return false;
+	}
+
+	return resultCache()->contains(cacheKey(data), _sync ? 0 : _maxCacheAge);
+}
+
+void ParseQuery::clearCachedResult()
+{
+	ParseError *error = NULL;
+	QVariant data(cacheConstraints(&error));
+	if (!data.isValid()) {
+		delete error;
+		return;
+	}
+
+	resultCache()->remove(cacheKey(data));
+}
+
+void ParseQuery::clearAllCachedResults()
+{
+	ParseManager::instance()->cache()->clear();
+	ParseManager::instance()->syncCache()->clear();
+}
+
 void ParseQuery::findObjects()
 {
 	Q_ASSERT(!_className.isEmpty());
@@ -160,15 +305,36 @@ void ParseQuery::findObjects()
 		return;
 	}
 	setBusy(true);
+	_retries = 0;
+
+	if (_localDatastore) {
+		findLocalObjects();
+		return;
+	}
+	if (_sync) {
+		syncObjects();
+		return;
+	}
 
 	ParseError *error = NULL;
 	QVariant data(constraints(&error));
 
 	if (data.isValid()) {
+		_cacheKey = cacheKey(data);
+		if (findObjectsFromCache()) {
+			return;
+		}
+	}
+
+	if (data.isValid() && _cachePolicy == CacheOnly) {
+		error = new ParseError(ParseError::DomainParse, ParseError::ParseCodeCacheMiss, "cache miss");
+	}
+	else if (data.isValid()) {
 		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
 								   	      	  	  "classes/" + _className,
 								   	      	  	  data,
-								   	      	  	  this, SLOT(findObjectsFinished()));
+								   	      	  	  this, SLOT(findObjectsFinished()),
+								   	      	  	  _streaming ? SLOT(findObjectsReadyRead()) : 0);
 	}
 
 	if (error) {
@@ -184,94 +350,987 @@ void ParseQuery::findObjectsFinished()
 	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
 	reply->deleteLater();
 
+	_retries = ParseScheduler::retries(reply);
+
+	setBusy(false);
+
+	if (_reader) {
+		findObjectsStreamFinished(reply);
+		return;
+	}
+
+	ParseError *error = NULL;
+	QByteArray body;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error, &body);
+	if (!json.isValid()) {
+		completeFindObjects(QVariant(), error, QByteArray());
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QVariant results = resultsFromJson(json.toMap().value("results").toList());
+	ParseRequestMetrics::addObjectifyTime(reply, timer);
+
+	completeFindObjects(results, NULL, body);
+}
+
+void ParseQuery::findObjectsReadyRead()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+
+	if (!_reader) {
+		// leave error replies to the regular handling when finished
+		if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) {
+			return;
+		}
+		_reader = new ParseStreamReader("results");
+	}
+
+	if (_streamError) {
+		reply->readAll();
+		return;
+	}
+	QByteArray data = ParseManager::readReply(reply, &_streamError);
+	if (_streamError) {
+		return;
+	}
+	if (writesCache()) {
+		_streamBody.append(data);
+	}
+
+	decodeStream(reply, data, &_streamError);
+}
+
+void ParseQuery::findObjectsStreamFinished(QNetworkReply *reply)
+{
+	ParseError *error = _streamError;
+	_streamError = NULL;
+
+	if (!error) {
+		error = ParseManager::replyError(reply);
+	}
+	QByteArray data;
+	if (!error) {
+		data = ParseManager::readReply(reply, &error);
+	}
+	if (!error && decodeStream(reply, data, &error) && !_reader->atEnd()) {
+		error = new ParseError(ParseError::DomainJson, ParseError::JsonCodeFailed, "truncated results");
+	}
+
+	delete _reader;
+	_reader = NULL;
+
+	QVariant results = _lazyResults ? resultsFromJson(_streamResults) : QVariant(_streamResults);
+	_streamResults.clear();
+	QByteArray body = _streamBody + data;
+	_streamBody.clear();
+
+	completeFindObjects(results, error, body);
+}
+
+bool ParseQuery::decodeStream(QNetworkReply *reply, const QByteArray &data, ParseError **error)
+{
+	QElapsedTimer timer;
+	timer.start();
+	QVariantList jsonResults;
+	bool ok = _reader->feed(data, &jsonResults, error);
+	ParseRequestMetrics::addDecodeTime(reply, timer);
+
+	if (!jsonResults.isEmpty()) {
+		timer.start();
+		QVariant results = resultsFromJson(jsonResults);
+		ParseRequestMetrics::addObjectifyTime(reply, timer);
+		_streamResults.append(_lazyResults ? jsonResults : results.toList());
+
+		Q_EMIT findObjectsReceived(results);
+	}
+
+	return ok;
+}
+
+QVariant ParseQuery::filterObjects(const QVariant &objects)
+{
+	ParseQueryEvaluator evaluator;
+	ParseError *error = NULL;
+	if (!evaluator.compile(_where, _order, &error)) {
+		qWarning() << "ParseQuery: can't filter objects:" << error->error();
+		delete error;
+		return QVariant();
+	}
+
+	QVariantList list = objects.toList();
+	if (list.isEmpty() || list.first().type() == QVariant::Map) {
+		return evaluator.filter(list, _limit, _skip);
+	}
+
+	QList<ParseObject *> parseObjects;
+	parseObjects.reserve(list.size());
+	foreach (const QVariant &variant, list) {
+		ParseObject *object = objectFromVariant(variant);
+		if (object) {
+			parseObjects.append(object);
+		}
+	}
+
+	QVariantList results;
+	foreach (ParseObject *object, evaluator.filter(parseObjects, _limit, _skip)) {
+		results.append(QVariant::fromValue(object));
+	}
+	return results;
+}
+
+QList<ParseObject *> ParseQuery::filterObjects(const QList<ParseObject *> &objects, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	ParseQueryEvaluator evaluator;
+	if (!evaluator.compile(_where, _order, error)) {
+		return QList<ParseObject *>();
+	}
+
+	return evaluator.filter(objects, _limit, _skip);
+}
+
+void ParseQuery::countObjects()
+{
+	Q_ASSERT(!_className.isEmpty());
+
+	if (_busy) {
+		return;
+	}
+	setBusy(true);
+	_retries = 0;
+
+	if (_localDatastore) {
+		countLocalObjects();
+		return;
+	}
+
+	ParseError *error = NULL;
+	QVariant data(constraints(&error, true));
+
+	if (data.isValid()) {
+		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+								   	      	  	  "classes/" + _className,
+								   	      	  	  data,
+								   	      	  	  this, SLOT(countObjectsFinished()));
+	}
+
+	if (error) {
+		setBusy(false);
+
+		Q_EMIT countObjectsCompleted(-1, error);
+		error->deleteLater();
+	}
+}
+
+void ParseQuery::countObjectsFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	_retries = ParseScheduler::retries(reply);
+
 	setBusy(false);
 
 	ParseError *error = NULL;
 	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
 	if (!json.isValid()) {
-		Q_EMIT findObjectsCompleted(QVariant(), error);
+		Q_EMIT countObjectsCompleted(-1, error);
 		error->deleteLater();
 		return;
 	}
 
+	Q_EMIT countObjectsCompleted(json.toMap().value("count").toInt(), NULL);
+}
+
+QVariantList ParseQuery::objectsFromJson(const QVariantList &jsonResults)
+{
 	QVariantList results;
-	QVariantList jsonResults = json.toMap().value("results").toList();
-	foreach (const QVariant &jsonResult, jsonResults) {
-		ParseObject *result = new ParseObject();
-		result->setClassName(_className);
-		result->setData(jsonResult.toMap());
+	results.reserve(jsonResults.size());
 
-		results.append(QVariant::fromValue(result));
+	foreach (const QVariant &jsonResult, jsonResults) {
+		results.append(QVariant::fromValue(objectFromJson(jsonResult.toMap())));
 	}
 
-	Q_EMIT findObjectsCompleted(results, NULL);
+	return results;
 }
 
-void ParseQuery::where(const QString &op, const QString &key, const QVariant &what)
+QVariant ParseQuery::resultsFromJson(const QVariantList &jsonResults)
 {
-	Q_ASSERT(!key.isEmpty());
-	Q_ASSERT(what.isValid());
-
-	QVariantMap value = _where.value(key, QVariantMap()).toMap();
-	value.insert(op, what);
-	_where.insert(key, value);
+	if (_lazyResults) {
+		return QVariant::fromValue(ParseRows(_className, jsonResults, !_selectedKeys.isEmpty()));
+	}
+	return objectsFromJson(jsonResults);
 }
 
-void ParseQuery::addOrder(const QString &key, Qt::SortOrder sortOrder)
+void ParseQuery::findAll()
 {
-	Q_ASSERT(!key.isEmpty());
+	Q_ASSERT(!_className.isEmpty());
 
-	QVariantMap entry;
-	entry.insert("order", sortOrder);
-	entry.insert("key", key);
-	_order.append(entry);
+	if (_busy) {
+		return;
+	}
+	setBusy(true);
+	_retries = 0;
+
+	_findAllCursor = QDateTime();
+	_findAllTies.clear();
+	_findAllCount = 0;
+	_findAllPaused = false;
+	_findAllPending = false;
+	_findAllCancelled = false;
+
+	if (_localDatastore) {
+		findAllLocalObjects();
+		return;
+	}
+
+	requestFindAllPage();
 }
 
-QVariant ParseQuery::constraints(ParseError **error)
+void ParseQuery::pauseFindAll()
 {
-	QByteArray buffer;
+	_findAllPaused = true;
+}
 
-	if (!_where.isEmpty()) {
-		QByteArray json(ParseJson::write(_where, error));
-		if (json.isEmpty()) {
-			return QVariant();
-		}
-		buffer.append("where=");
-		buffer.append(QUrl::toPercentEncoding(json));
+void ParseQuery::resumeFindAll()
+{
+	_findAllPaused = false;
+
+	if (_findAllPending) {
+		_findAllPending = false;
+		requestFindAllPage();
 	}
+}
 
-	if (!_order.isEmpty()) {
-		if (buffer.size()) {
-			buffer.append("&");
-		}
-		buffer.append("order=");
-		foreach (const QVariant &entry, _order) {
-			QVariantMap entryMap = entry.toMap();
-			if (entryMap.value("order").toInt() == Qt::DescendingOrder) {
-				buffer.append("-");
-			}
-			QString key = entryMap.value("key").toString();
-			buffer.append(QUrl::toPercentEncoding(key));
-		}
+void ParseQuery::cancelFindAll()
+{
+	_findAllCancelled = true;
+
+	if (_findAllPending) {
+		_findAllPending = false;
+		completeFindAll(NULL);
 	}
+}
 
-	if (_limit > -1) {
-		if (buffer.size()) {
-			buffer.append("&");
-		}
-		buffer.append("limit=");
-		buffer.append(QString().setNum(_limit));
+void ParseQuery::requestFindAllPage()
+{
+	// resume after the last page: at or after its creation time, but without the objects seen at that time
+	QVariantMap where = _where;
+	if (_findAllCursor.isValid()) {
+		QVariantMap createdAt = where.value("createdAt").toMap();
+		createdAt.remove("$gt");
+		createdAt.insert("$gte", _findAllCursor);
+		where.insert("createdAt", createdAt);
+
+		QVariantMap objectId = where.value("objectId").toMap();
+		objectId.insert("$nin", objectId.value("$nin").toList() + _findAllTies);
+		where.insert("objectId", objectId);
 	}
 
-	if (_skip > 0) {
-		if (buffer.size()) {
-			buffer.append("&");
-		}
-		buffer.append("skip=");
-		buffer.append(QString().setNum(_skip));
+	QVariantMap entry;
+	entry.insert("order", Qt::AscendingOrder);
+	entry.insert("key", "createdAt");
+	QVariantList order;
+	order.append(entry);
+
+	ParseError *error = NULL;
+	QVariant data(encodeConstraints(where, order, findAllPageSize(), 0, false, &error));
+
+	if (data.isValid()) {
+		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+								   	      	  	  "classes/" + _className,
+								   	      	  	  data,
+								   	      	  	  this, SLOT(findAllPageFinished()), 0,
+								   	      	  	  ParseScheduler::PriorityBackground);
 	}
 
-	return QVariant(buffer);
+	if (error) {
+		completeFindAll(error);
+		error->deleteLater();
+	}
+}
+
+void ParseQuery::findAllPageFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	_retries += ParseScheduler::retries(reply);
+
+	if (_findAllCancelled) {
+		completeFindAll(NULL);
+		return;
+	}
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	if (!json.isValid()) {
+		completeFindAll(error);
+		error->deleteLater();
+		return;
+	}
+
+	QVariantList jsonResults = json.toMap().value("results").toList();
+
+	// move the cursor to the newest object, remembering all objects created at that time
+	if (!jsonResults.isEmpty()) {
+		QString cursorString = jsonResults.last().toMap().value("createdAt").toString();
+		QDateTime cursor = ParseManager::dateTimeFromString(cursorString);
+		if (cursor != _findAllCursor) {
+			_findAllCursor = cursor;
+			_findAllTies.clear();
+		}
+		for (int i = jsonResults.size() - 1; i >= 0; --i) {
+			QVariantMap jsonResult = jsonResults.at(i).toMap();
+			if (jsonResult.value("createdAt").toString() != cursorString) {
+				break;
+			}
+			_findAllTies.append(jsonResult.value("objectId"));
+		}
+	}
+	_findAllCount += jsonResults.size();
+
+	QElapsedTimer timer;
+	timer.start();
+	QVariant results = resultsFromJson(jsonResults);
+	ParseRequestMetrics::addObjectifyTime(reply, timer);
+
+	Q_EMIT findAllPageReceived(results);
+
+	if (jsonResults.size() < findAllPageSize() || _findAllCancelled) {
+		completeFindAll(NULL);
+	}
+	else if (_findAllPaused) {
+		_findAllPending = true;
+	}
+	else {
+		requestFindAllPage();
+	}
+}
+
+void ParseQuery::completeFindAll(ParseError *error)
+{
+	_findAllTies.clear();
+	_parallelBuffered.clear();
+	_parallelRequests.clear();
+	setBusy(false);
+
+	Q_EMIT findAllCompleted(_findAllCount, error);
+}
+
+void ParseQuery::findAllParallel()
+{
+	Q_ASSERT(!_className.isEmpty());
+
+	if (_busy) {
+		return;
+	}
+	setBusy(true);
+	_retries = 0;
+
+	_findAllCount = 0;
+	_findAllCancelled = false;
+	_parallelPages = 0;
+	_parallelNextPage = 0;
+	_parallelNextEmit = 0;
+	_parallelInFlight = 0;
+	_parallelBuffered.clear();
+	_parallelRequests.clear();
+	_parallelError = NULL;
+
+	if (_localDatastore) {
+		findAllLocalObjects();
+		return;
+	}
+
+	// the total decides how many pages to fetch
+	ParseError *error = NULL;
+	QVariant data(constraints(&error, true));
+
+	if (data.isValid()) {
+		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+								   	      	  	  "classes/" + _className,
+								   	      	  	  data,
+								   	      	  	  this, SLOT(parallelCountFinished()));
+	}
+
+	if (error) {
+		completeFindAll(error);
+		error->deleteLater();
+	}
+}
+
+int ParseQuery::parallelism() const
+{
+	return _parallelism;
+}
+
+void ParseQuery::setParallelism(int parallelism)
+{
+	Q_ASSERT(parallelism > 0);
+
+	_parallelism = parallelism;
+}
+
+bool ParseQuery::ordered() const
+{
+	return _ordered;
+}
+
+void ParseQuery::setOrdered(bool ordered)
+{
+	_ordered = ordered;
+}
+
+void ParseQuery::parallelCountFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	_retries += ParseScheduler::retries(reply);
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	if (!json.isValid()) {
+		completeFindAll(error);
+		error->deleteLater();
+		return;
+	}
+
+	int total = json.toMap().value("count").toInt() - _skip;
+	int pageSize = findAllPageSize();
+	_parallelPages = total > 0 ? (total + pageSize - 1) / pageSize : 0;
+
+	requestParallelPages();
+}
+
+void ParseQuery::requestParallelPages()
+{
+	QVariantList order = totalOrder();
+
+	while (_parallelInFlight < _parallelism && _parallelNextPage < _parallelPages && !_parallelError && !_findAllCancelled) {
+		int pageSize = findAllPageSize();
+
+		ParseError *error = NULL;
+		QVariant data(encodeConstraints(_where, order, pageSize, _skip + _parallelNextPage * pageSize, false, &error));
+
+		QString path = "classes/" + _className;
+		if (data.isValid()) {
+			error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+									   	      	  	  path,
+									   	      	  	  data,
+									   	      	  	  this, SLOT(parallelPageFinished()));
+		}
+
+		if (error) {
+			_parallelError = error;
+			break;
+		}
+
+		// the reply is recognized by its url, as the pages of ParseQueryModel
+		QUrl url = ParseManager::instance()->serverUrl().resolved(QUrl(path));
+		url.setEncodedQuery(data.toByteArray());
+		_parallelRequests.insert(url.toEncoded(), _parallelNextPage);
+
+		++_parallelNextPage;
+		++_parallelInFlight;
+	}
+
+	if (!_parallelInFlight && (_parallelNextPage >= _parallelPages || _parallelError || _findAllCancelled)) {
+		ParseError *error = _parallelError;
+		_parallelError = NULL;
+
+		completeFindAll(error);
+		if (error) {
+			error->deleteLater();
+		}
+	}
+}
+
+void ParseQuery::parallelPageFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	_retries += ParseScheduler::retries(reply);
+	--_parallelInFlight;
+	int page = _parallelRequests.take(reply->url().toEncoded());
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+
+	if (error) {
+		// the first error ends the read once the pages in flight are done
+		if (!_parallelError) {
+			_parallelError = error;
+		}
+		else {
+			error->deleteLater();
+		}
+	}
+	else if (!_findAllCancelled && !_parallelError) {
+		QElapsedTimer timer;
+		timer.start();
+		QVariantList jsonResults = json.toMap().value("results").toList();
+		QVariant results = resultsFromJson(jsonResults);
+		ParseRequestMetrics::addObjectifyTime(reply, timer);
+		_findAllCount += jsonResults.size();
+
+		if (_ordered) {
+			_parallelBuffered.insert(page, results);
+
+			while (_parallelBuffered.contains(_parallelNextEmit)) {
+				Q_EMIT findAllPageReceived(_parallelBuffered.take(_parallelNextEmit++));
+			}
+		}
+		else {
+			Q_EMIT findAllPageReceived(results);
+		}
+	}
+
+	requestParallelPages();
+}
+
+void ParseQuery::getLocalObjectById(const QString &objectId)
+{
+	ParseError *error = NULL;
+	QVariantMap json = ParseManager::instance()->localStore()->get(_className, objectId, _selectedKeys, &error);
+	if (!error && json.isEmpty()) {
+		error = new ParseError(ParseError::DomainParse, ParseError::ParseCodeObjectNotFound, "object not found");
+	}
+
+	setBusy(false);
+
+	if (error) {
+		Q_EMIT getObjectByIdCompleted(NULL, error);
+		error->deleteLater();
+		return;
+	}
+
+	Q_EMIT getObjectByIdCompleted(objectFromJson(json), NULL);
+}
+
+void ParseQuery::findLocalObjects()
+{
+	ParseError *error = NULL;
+	QVariantList json = ParseManager::instance()->localStore()->find(_className, _where, _order, _selectedKeys, _limit, _skip, &error);
+
+	setBusy(false);
+
+	if (error) {
+		Q_EMIT findObjectsCompleted(QVariant(), error);
+		error->deleteLater();
+		return;
+	}
+
+	Q_EMIT findObjectsCompleted(resultsFromJson(json), NULL);
+}
+
+void ParseQuery::countLocalObjects()
+{
+	ParseError *error = NULL;
+	int count = ParseManager::instance()->localStore()->count(_className, _where, &error);
+
+	setBusy(false);
+
+	Q_EMIT countObjectsCompleted(count, error);
+	if (error) {
+		error->deleteLater();
+	}
+}
+
+void ParseQuery::findAllLocalObjects()
+{
+	ParseError *error = NULL;
+	QVariantList json = ParseManager::instance()->localStore()->find(_className, _where, _order, _selectedKeys, -1, _skip, &error);
+
+	if (!error) {
+		_findAllCount = json.size();
+
+		Q_EMIT findAllPageReceived(resultsFromJson(json));
+	}
+
+	completeFindAll(error);
+	if (error) {
+		error->deleteLater();
+	}
+}
+
+QVariantList ParseQuery::totalOrder() const
+{
+	// skip partitions are only disjoint for a total order, so objectId breaks the ties
+	QVariantList order = _order;
+	bool hasObjectIdOrder = false;
+	foreach (const QVariant &entry, order) {
+		hasObjectIdOrder |= entry.toMap().value("key") == "objectId";
+	}
+	if (!hasObjectIdOrder) {
+		QVariantMap entry;
+		entry.insert("order", Qt::AscendingOrder);
+		entry.insert("key", "objectId");
+		order.append(entry);
+	}
+	return order;
+}
+
+int ParseQuery::findAllPageSize() const
+{
+	return _limit > 0 ? qMin(_limit, PQ_QUERY_MAX_LIMIT) : PQ_QUERY_MAX_LIMIT;
+}
+
+ParseObject *ParseQuery::objectFromJson(const QVariantMap &json)
+{
+	return ParseObject::objectFromJson(_className, json, !_selectedKeys.isEmpty());
+}
+
+void ParseQuery::syncObjects()
+{
+	ParseError *error = NULL;
+	QVariant data(cacheConstraints(&error));
+	if (!data.isValid()) {
+		completeSync(error);
+		return;
+	}
+	_cacheKey = cacheKey(data);
+
+	// start from the objects synced before, if any
+	ParseCache *cache = resultCache();
+	QByteArray body;
+	if (cache->lookup(_cacheKey, 0, &body)) {
+		QVariant json = ParseJson::read(body, &error);
+		if (json.isValid()) {
+			mergeSyncPage(json.toMap().value("results").toList());
+		}
+		else {
+			cache->remove(_cacheKey);
+			delete error;
+		}
+	}
+
+	// objects cached at the watermark may have been updated since, so they are fetched again
+	_syncTies.clear();
+
+	requestSyncPage();
+}
+
+void ParseQuery::requestSyncPage()
+{
+	// objects updated at or after the newest one synced, without those just fetched at that time
+	QVariantMap where = _where;
+	if (_syncCursor.isValid()) {
+		QVariantMap updatedAt = where.value("updatedAt").toMap();
+		updatedAt.remove("$gt");
+		updatedAt.insert("$gte", _syncCursor);
+		where.insert("updatedAt", updatedAt);
+	}
+	if (!_syncTies.isEmpty()) {
+		QVariantMap objectId = where.value("objectId").toMap();
+		objectId.insert("$nin", objectId.value("$nin").toList() + _syncTies);
+		where.insert("objectId", objectId);
+	}
+
+	QVariantMap entry;
+	entry.insert("order", Qt::AscendingOrder);
+	entry.insert("key", "updatedAt");
+	QVariantList order;
+	order.append(entry);
+
+	ParseError *error = NULL;
+	QVariant data(encodeConstraints(where, order, PQ_QUERY_MAX_LIMIT, 0, false, &error));
+
+	if (data.isValid()) {
+		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+								   	      	  	  "classes/" + _className,
+								   	      	  	  data,
+								   	      	  	  this, SLOT(syncPageFinished()));
+	}
+
+	if (error) {
+		completeSync(error);
+	}
+}
+
+void ParseQuery::syncPageFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	_retries += ParseScheduler::retries(reply);
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	if (!json.isValid()) {
+		completeSync(error);
+		return;
+	}
+
+	QVariantList jsonResults = json.toMap().value("results").toList();
+	mergeSyncPage(jsonResults);
+
+	// a full page may be followed by more updates
+	if (jsonResults.size() == PQ_QUERY_MAX_LIMIT) {
+		requestSyncPage();
+		return;
+	}
+
+	completeSync(NULL);
+}
+
+void ParseQuery::mergeSyncPage(const QVariantList &jsonResults)
+{
+	foreach (const QVariant &jsonResult, jsonResults) {
+		QVariantMap jsonMap = jsonResult.toMap();
+		QString objectId = jsonMap.value("objectId").toString();
+
+		QHash<QString, int>::const_iterator i = _syncIndexes.constFind(objectId);
+		if (i != _syncIndexes.constEnd()) {
+			_syncResults[i.value()] = jsonResult;
+		}
+		else {
+			_syncIndexes.insert(objectId, _syncResults.size());
+			_syncResults.append(jsonResult);
+		}
+
+		QDateTime updatedAt = ParseManager::dateTimeFromString(jsonMap.value("updatedAt").toString());
+		if (updatedAt > _syncCursor) {
+			_syncCursor = updatedAt;
+			_syncTies.clear();
+		}
+		if (updatedAt == _syncCursor) {
+			_syncTies.append(objectId);
+		}
+	}
+}
+
+void ParseQuery::completeSync(ParseError *error)
+{
+	setBusy(false);
+
+	QVariantList jsonResults = _syncResults;
+	_syncResults.clear();
+	_syncIndexes.clear();
+	_syncCursor = QDateTime();
+	_syncTies.clear();
+
+	if (!error) {
+		// the merged objects are the base of the next sync
+		QVariantMap json;
+		json.insert("results", jsonResults);
+		QByteArray body(ParseJson::write(json, &error));
+		if (!body.isEmpty() && !resultCache()->insert(_cacheKey, body)) {
+			qWarning() << "ParseQuery: can't store synced results, the next sync fetches all objects again";
+		}
+	}
+
+	if (!error) {
+		// nothing is filtered, the server matched the constraints already
+		ParseQueryEvaluator evaluator;
+		evaluator.compile(QVariantMap(), _order, &error);
+		jsonResults = evaluator.filter(jsonResults, _limit, _skip);
+	}
+
+	if (error) {
+		Q_EMIT findObjectsCompleted(QVariant(), error);
+		error->deleteLater();
+		return;
+	}
+
+	Q_EMIT findObjectsCompleted(resultsFromJson(jsonResults), NULL);
+}
+
+bool ParseQuery::findObjectsFromCache()
+{
+	if (_cachePolicy != CacheOnly && _cachePolicy != CacheElseNetwork && _cachePolicy != CacheThenNetwork) {
+		return false;
+	}
+
+	QVariant results = cachedResults();
+	if (!results.isValid()) {
+		return false;
+	}
+
+	// with CacheThenNetwork the query stays busy until the network results arrived
+	bool done = _cachePolicy != CacheThenNetwork;
+	if (done) {
+		setBusy(false);
+	}
+
+	Q_EMIT findObjectsCompleted(results, NULL);
+	return done;
+}
+
+void ParseQuery::completeFindObjects(const QVariant &results, ParseError *error, const QByteArray &body)
+{
+	if (error) {
+		QVariant cached;
+		if (_cachePolicy == NetworkElseCache) {
+			cached = cachedResults();
+		}
+		if (cached.isValid()) {
+			Q_EMIT findObjectsCompleted(cached, NULL);
+		}
+		else {
+			Q_EMIT findObjectsCompleted(QVariant(), error);
+		}
+		error->deleteLater();
+		return;
+	}
+
+	if (writesCache()) {
+		ParseManager::instance()->cache()->insert(_cacheKey, body);
+	}
+
+	Q_EMIT findObjectsCompleted(results, NULL);
+}
+
+QVariant ParseQuery::cachedResults()
+{
+	ParseCache *cache = ParseManager::instance()->cache();
+
+	QByteArray body;
+	if (!cache->lookup(_cacheKey, _maxCacheAge, &body)) {
+		return QVariant();
+	}
+
+	ParseError *error = NULL;
+	QVariant json = ParseJson::read(body, &error);
+	if (!json.isValid()) {
+		cache->remove(_cacheKey);
+		delete error;
+		return QVariant();
+	}
+
+	return resultsFromJson(json.toMap().value("results").toList());
+}
+
+ParseCache *ParseQuery::resultCache() const
+{
+	return _sync ? ParseManager::instance()->syncCache() : ParseManager::instance()->cache();
+}
+
+QVariant ParseQuery::cacheConstraints(ParseError **error)
+{
+	// synced results hold all matching objects, whatever the order, skip and limit
+	return _sync ? encodeConstraints(_where, QVariantList(), -1, 0, false, error) : constraints(error);
+}
+
+QString ParseQuery::cacheKey(const QVariant &constraints) const
+{
+	QString key = ParseManager::instance()->serverUrl().toString() + _className + "?" + QString::fromUtf8(constraints.toByteArray());
+	return _sync ? key + "#sync" : key;
+}
+
+bool ParseQuery::writesCache() const
+{
+	return _cachePolicy != IgnoreCache && _cachePolicy != CacheOnly;
+}
+
+void ParseQuery::where(const QString &op, const QString &key, const QVariant &what)
+{
+	Q_ASSERT(!key.isEmpty());
+	Q_ASSERT(what.isValid());
+
+	QVariantMap value = _where.value(key, QVariantMap()).toMap();
+	value.insert(op, what);
+	_where.insert(key, value);
+}
+
+void ParseQuery::addOrder(const QString &key, Qt::SortOrder sortOrder)
+{
+	Q_ASSERT(!key.isEmpty());
+
+	QVariantMap entry;
+	entry.insert("order", sortOrder);
+	entry.insert("key", key);
+	_order.append(entry);
+}
+
+QVariant ParseQuery::constraints(ParseError **error, bool count)
+{
+	return encodeConstraints(_where, _order, count ? 0 : _limit, count ? 0 : _skip, count, error);
+}
+
+QVariant ParseQuery::encodeConstraints(const QVariantMap &where, const QVariantList &order, int limit, int skip, bool count, ParseError **error) const
+{
+	QByteArray buffer;
+
+	if (!where.isEmpty()) {
+		// constraints may hold dates or bytes
+		QVariant jsonWhere = ParseManager::instance()->jsonify(where, error);
+		if (*error) {
+			return QVariant();
+		}
+		QByteArray json(ParseJson::write(jsonWhere, error));
+		if (json.isEmpty()) {
+			return QVariant();
+		}
+		buffer.append("where=");
+		buffer.append(QUrl::toPercentEncoding(json));
+	}
+
+	// counting ignores ordering and paging, limit=0 keeps the results out of the reply
+	if (count) {
+		if (buffer.size()) {
+			buffer.append("&");
+		}
+		buffer.append("count=1&limit=0");
+		return QVariant(buffer);
+	}
+
+	if (!_selectedKeys.isEmpty()) {
+		if (buffer.size()) {
+			buffer.append("&");
+		}
+		buffer.append(keysConstraint());
+	}
+
+	if (!order.isEmpty()) {
+		if (buffer.size()) {
+			buffer.append("&");
+		}
+		buffer.append("order=");
+		for (int i = 0; i < order.size(); ++i) {
+			QVariantMap entryMap = order.at(i).toMap();
+			if (i) {
+				buffer.append(",");
+			}
+			if (entryMap.value("order").toInt() == Qt::DescendingOrder) {
+				buffer.append("-");
+			}
+			QString key = entryMap.value("key").toString();
+			buffer.append(QUrl::toPercentEncoding(key));
+		}
+	}
+
+	if (limit > -1) {
+		if (buffer.size()) {
+			buffer.append("&");
+		}
+		buffer.append("limit=");
+		buffer.append(QString().setNum(limit));
+	}
+
+	if (skip > 0) {
+		if (buffer.size()) {
+			buffer.append("&");
+		}
+		buffer.append("skip=");
+		buffer.append(QString().setNum(skip));
+	}
+
+	return QVariant(buffer);
+}
+
+QByteArray ParseQuery::keysConstraint() const
+{
+	if (_selectedKeys.isEmpty()) {
+		return QByteArray();
+	}
+
+	return "keys=" + QUrl::toPercentEncoding(_selectedKeys.join(","), ",");
 }
 
 void ParseQuery::setBusy(bool busy)
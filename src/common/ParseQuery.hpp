@@ -8,22 +8,49 @@
 #ifndef PARSEQT__PARSE_QUERY_HPP_
 #define PARSEQT__PARSE_QUERY_HPP_
 
+#include <QDateTime>
+#include <QHash>
 #include <QVariant>
 #include <QMetaType>
+#include <QStringList>
+
+class QNetworkReply;
 
 namespace parseqt {
 
 class ParseObject;
 class ParseError;
+class ParseStreamReader;
+class ParseCache;
 
 class ParseQuery : public QObject {
 	Q_OBJECT
 	Q_PROPERTY(QString className READ className WRITE setClassName FINAL)
 	Q_PROPERTY(int limit READ limit WRITE setLimit FINAL)
 	Q_PROPERTY(int skip READ skip WRITE setSkip FINAL)
+	Q_PROPERTY(QStringList selectedKeys READ selectedKeys WRITE selectKeys FINAL)
+	Q_PROPERTY(bool streaming READ streaming WRITE setStreaming FINAL)
+	Q_PROPERTY(bool lazyResults READ lazyResults WRITE setLazyResults FINAL)
+	Q_PROPERTY(int parallelism READ parallelism WRITE setParallelism FINAL)
+	Q_PROPERTY(bool ordered READ ordered WRITE setOrdered FINAL)
+	Q_PROPERTY(bool localDatastore READ localDatastore WRITE setLocalDatastore FINAL)
+	Q_PROPERTY(bool sync READ sync WRITE setSync FINAL)
+	Q_PROPERTY(CachePolicy cachePolicy READ cachePolicy WRITE setCachePolicy FINAL)
+	Q_PROPERTY(int maxCacheAge READ maxCacheAge WRITE setMaxCacheAge FINAL)
 	Q_PROPERTY(bool busy READ busy NOTIFY busyChanged FINAL)
+	Q_PROPERTY(int retries READ retries FINAL)
+	Q_ENUMS(CachePolicy)
 
 public:
+	enum CachePolicy {
+		IgnoreCache = 0,
+		CacheOnly = 1,
+		NetworkOnly = 2,
+		CacheElseNetwork = 3,
+		NetworkElseCache = 4,
+		CacheThenNetwork = 5
+	};
+
 	/// creating a query
 	explicit ParseQuery(QObject *parent = 0);
 	virtual ~ParseQuery();
@@ -35,6 +62,9 @@ public:
 	bool busy() const;
 	Q_SIGNAL void busyChanged(bool busy);
 
+	/// number of retries needed by the last request, valid when its completion signal is emitted
+	int retries() const;
+
 	/// getting objects by id
 	Q_INVOKABLE void getObjectById(const QString &objectId);
 	Q_SIGNAL void getObjectByIdCompleted(parseqt::ParseObject *object, ParseError *error);
@@ -52,26 +82,145 @@ public:
 	Q_INVOKABLE void orderByDescending(const QString &key);
 	Q_INVOKABLE void addDescendingOrder(const QString &key);
 
+	/// field projection - only the given keys (and objectId, createdAt, updatedAt) are fetched,
+	/// the resulting objects are partial
+	Q_INVOKABLE void selectKeys(const QStringList &keys);
+	QStringList selectedKeys() const;
+
 	/// pagination
 	int limit() const;
 	void setLimit(int limit);
 	int skip() const;
 	void setSkip(int skip);
 
-	/// finding objects as specified
+	/// streaming - if set, findObjects decodes results while they are downloaded and
+	/// reports them in batches via findObjectsReceived before findObjectsCompleted
+	bool streaming() const;
+	void setStreaming(bool streaming);
+
+	/// lazy results - if set, results are reported as a ParseRows value instead of a list of
+	/// ParseObjects, which creates objects only for the rows accessed (for C++ receivers)
+	bool lazyResults() const;
+	void setLazyResults(bool lazyResults);
+
+	/// querying the objects pinned to the local datastore instead of the server - results are
+	/// reported right away through the usual signals, caching and streaming don't apply, no limit
+	/// returns all matches and findAll and findAllParallel report all matches in a single page
+	Q_INVOKABLE void fromLocalDatastore();
+	bool localDatastore() const;
+	void setLocalDatastore(bool localDatastore);
+
+	/// delta sync - if set, findObjects keeps all matching objects in the cache and only fetches those
+	/// updated after the newest one cached, which are merged by objectId; the merged objects are then
+	/// ordered, skipped and limited locally and reported via findObjectsCompleted - cachePolicy,
+	/// maxCacheAge and streaming don't apply; objects deleted or no longer matching on the server stay
+	/// cached until clearCachedResult forces a full fetch - synced objects are stored apart from the
+	/// size bounded cache of other results, without limit, and are only dropped by clearing them
+	bool sync() const;
+	void setSync(bool sync);
+
+	/// caching query results - with CacheThenNetwork, findObjectsCompleted is emitted twice
+	/// maxCacheAge is in seconds, cached results of any age are used if it is 0
+	CachePolicy cachePolicy() const;
+	void setCachePolicy(CachePolicy cachePolicy);
+	int maxCacheAge() const;
+	void setMaxCacheAge(int maxCacheAge);
+
+	Q_INVOKABLE bool hasCachedResult();
+	Q_INVOKABLE void clearCachedResult();
+	Q_INVOKABLE void clearAllCachedResults();
+
+	/// finding objects as specified - results are the live objects already loaded, updated with the
+	/// fetched values except for keys changed locally, or new objects; queries share them, so they
+	/// must not be deleted by a single receiver
 	Q_INVOKABLE void findObjects();
+	Q_SIGNAL void findObjectsReceived(const QVariant &results);
 	Q_SIGNAL void findObjectsCompleted(const QVariant &results, parseqt::ParseError *error);
 
+	/// iterating over all matching objects - pages of up to limit (at most 1000) objects are fetched one
+	/// after the other, ordered by createdAt and continuing after the last object of the previous page,
+	/// so that the whole class is walked without slow skips; other orderings are ignored
+	/// while paused, the next page is not requested until resumed
+	Q_INVOKABLE void findAll();
+	Q_INVOKABLE void pauseFindAll();
+	Q_INVOKABLE void resumeFindAll();
+	Q_INVOKABLE void cancelFindAll();
+	Q_SIGNAL void findAllPageReceived(const QVariant &results);
+
+	/// bulk reading all matching objects with up to parallelism page requests at once - the total is
+	/// counted first, then disjoint skip/limit pages (of limit objects, at most 1000) in the query's
+	/// order are requested; pages are reported via findAllPageReceived in order, or as they arrive if
+	/// ordered is false, and the end via findAllCompleted - cancelFindAll applies as well
+	Q_INVOKABLE void findAllParallel();
+	int parallelism() const;
+	void setParallelism(int parallelism);
+	bool ordered() const;
+	void setOrdered(bool ordered);
+
+	Q_SIGNAL void findAllCompleted(int count, parseqt::ParseError *error);
+
+	/// filtering and sorting objects already at hand by the constraints, order, skip and limit of the
+	/// query, without a request - objects is a list of ParseObjects or of json maps (as in cached
+	/// replies), a list of the same kind is returned, or an invalid variant if a constraint can't be
+	/// evaluated locally
+	Q_INVOKABLE QVariant filterObjects(const QVariant &objects);
+	QList<ParseObject *> filterObjects(const QList<ParseObject *> &objects, ParseError **error);
+
+	/// counting the objects matching the constraints without fetching them
+	Q_INVOKABLE void countObjects();
+	Q_SIGNAL void countObjectsCompleted(int count, parseqt::ParseError *error);
+
 private:
 	Q_DISABLE_COPY(ParseQuery)
 
+	friend class ParseQueryModel;
+
 	Q_SLOT void getObjectByIdFinished();
 	Q_SLOT void findObjectsFinished();
+	Q_SLOT void findObjectsReadyRead();
+	Q_SLOT void countObjectsFinished();
+	Q_SLOT void findAllPageFinished();
+	Q_SLOT void parallelCountFinished();
+	Q_SLOT void parallelPageFinished();
+	Q_SLOT void syncPageFinished();
+
+	void requestParallelPages();
+
+	void getLocalObjectById(const QString &objectId);
+	void findLocalObjects();
+	void countLocalObjects();
+	void findAllLocalObjects();
+
+	void requestFindAllPage();
+	void completeFindAll(ParseError *error);
+	int findAllPageSize() const;
+	QVariantList totalOrder() const;
+
+	void findObjectsStreamFinished(QNetworkReply *reply);
+	bool decodeStream(QNetworkReply *reply, const QByteArray &data, ParseError **error);
+	QVariantList objectsFromJson(const QVariantList &jsonResults);
+	QVariant resultsFromJson(const QVariantList &jsonResults);
+
+	void syncObjects();
+	void requestSyncPage();
+	void mergeSyncPage(const QVariantList &jsonResults);
+	void completeSync(ParseError *error);
+
+	bool findObjectsFromCache();
+	void completeFindObjects(const QVariant &results, ParseError *error, const QByteArray &body);
+	QVariant cachedResults();
+	ParseCache *resultCache() const;
+	QVariant cacheConstraints(ParseError **error);
+	QString cacheKey(const QVariant &constraints) const;
+	bool writesCache() const;
 
 	void where(const QString &op, const QString &key, const QVariant &what);
 	void addOrder(const QString &key, Qt::SortOrder sortOrder);
 
-	QVariant constraints(ParseError **error);
+	QVariant constraints(ParseError **error, bool count = false);
+	QVariant encodeConstraints(const QVariantMap &where, const QVariantList &order, int limit, int skip, bool count, ParseError **error) const;
+	QByteArray keysConstraint() const;
+	ParseObject *objectFromJson(const QVariantMap &json);
 
 	void setBusy(bool busy);
 
@@ -79,9 +228,41 @@ private:
 	QString _className;
 	QVariantMap _where;
 	QVariantList _order;
+	QStringList _selectedKeys;
 	int _limit;
 	int _skip;
 	bool _busy;
+	bool _streaming;
+	bool _lazyResults;
+	bool _localDatastore;
+	bool _sync;
+	ParseStreamReader *_reader;
+	ParseError *_streamError;
+	QVariantList _streamResults; // json rows with lazy results
+	QByteArray _streamBody;
+	CachePolicy _cachePolicy;
+	int _maxCacheAge;
+	QString _cacheKey;
+	int _retries;
+	QDateTime _findAllCursor;
+	QVariantList _findAllTies;
+	int _findAllCount;
+	bool _findAllPaused;
+	bool _findAllPending;
+	bool _findAllCancelled;
+	int _parallelism;
+	bool _ordered;
+	int _parallelPages;
+	int _parallelNextPage;
+	int _parallelNextEmit;
+	int _parallelInFlight;
+	QMap<int, QVariant> _parallelBuffered; // pages arrived ahead of their turn
+	QHash<QByteArray, int> _parallelRequests; // page by request url
+	ParseError *_parallelError;
+	QVariantList _syncResults; // json rows of all matching objects
+	QHash<QString, int> _syncIndexes; // by objectId
+	QDateTime _syncCursor;
+	QVariantList _syncTies;
 };
 
 } /* namespace parseqt */
@@ -0,0 +1,608 @@
+/*
+ * ParseQueryModel.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseQueryModel.hpp"
+
+#include "ParseObject.hpp"
+#include "ParseQuery.hpp"
+#include "internal/ParseManager.hpp"
+#include "ParseError.hpp"
+
+#include <QtNetwork/QNetworkReply>
+#include <QtAlgorithms>
+
+#define PQ_MODEL_DEFAULT_PAGE_SIZE	100
+#define PQ_MODEL_MAX_PAGE_SIZE	1000
+#define PQ_MODEL_DEFAULT_WINDOW_SIZE	1000
+
+namespace parseqt {
+
+static QString objectIdOf(const QVariant &jsonRow)
+{
+	return jsonRow.toMap().value("objectId").toString();
+}
+
+static QString createdAtOf(const QVariant &jsonRow)
+{
+	return jsonRow.toMap().value("createdAt").toString();
+}
+
+static int indexOfObjectId(const QVariantList &jsonRows, const QString &objectId, int from)
+{
+	for (int i = from; i < jsonRows.size(); ++i) {
+		if (objectIdOf(jsonRows.at(i)) == objectId) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+ParseQueryModel::ParseQueryModel(QObject *parent)
+	: QAbstractListModel(parent), _pageSize(PQ_MODEL_DEFAULT_PAGE_SIZE), _windowSize(PQ_MODEL_DEFAULT_WINDOW_SIZE),
+	  _rowCount(0), _atEnd(false), _busy(false), _lastReadPage(0)
+{
+	updateRoleNames();
+}
+
+ParseQueryModel::~ParseQueryModel() { }
+
+ParseQuery *ParseQueryModel::query() const
+{
+	return _query;
+}
+
+void ParseQueryModel::setQuery(ParseQuery *query)
+{
+	if (query != _query) {
+		_query = query;
+		clear();
+	}
+}
+
+QStringList ParseQueryModel::keys() const
+{
+	return _keys;
+}
+
+void ParseQueryModel::setKeys(const QStringList &keys)
+{
+	_keys = keys;
+	updateRoleNames();
+	clear();
+}
+
+int ParseQueryModel::pageSize() const
+{
+	return _pageSize;
+}
+
+void ParseQueryModel::setPageSize(int pageSize)
+{
+	Q_ASSERT(pageSize > 0);
+
+	_pageSize = qMin(pageSize, PQ_MODEL_MAX_PAGE_SIZE);
+	clear();
+}
+
+int ParseQueryModel::windowSize() const
+{
+	return _windowSize;
+}
+
+void ParseQueryModel::setWindowSize(int windowSize)
+{
+	Q_ASSERT(windowSize > 0);
+
+	_windowSize = windowSize;
+	evictPages();
+}
+
+int ParseQueryModel::count() const
+{
+	return _rowCount;
+}
+
+bool ParseQueryModel::busy() const
+{
+	return _busy;
+}
+
+void ParseQueryModel::reload()
+{
+	clear();
+	requestPage(0);
+}
+
+void ParseQueryModel::loadMore()
+{
+	fetchMore(QModelIndex());
+}
+
+void ParseQueryModel::refresh()
+{
+	if (_pageSizes.isEmpty()) {
+		reload();
+		return;
+	}
+
+	foreach (int page, _pages.keys()) {
+		requestPage(page);
+	}
+
+	// new objects may have been appended, to the last page or, if it is full, to a new one
+	if (_atEnd) {
+		requestPage(_pageSizes.last() < _pageSize ? _pageSizes.size() - 1 : _pageSizes.size());
+	}
+}
+
+ParseObject *ParseQueryModel::get(int row)
+{
+	if (row < 0 || row >= _rowCount) {
+		return NULL;
+	}
+
+	int page = pageOfRow(row);
+	QHash<int, ParseRows>::const_iterator i = _pages.constFind(page);
+	if (i == _pages.constEnd()) {
+		requestPage(page);
+		return NULL;
+	}
+
+	return rowObject(page, row - _pageStarts.at(page));
+}
+
+int ParseQueryModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : _rowCount;
+}
+
+QVariant ParseQueryModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid() || index.row() >= _rowCount) {
+		return QVariant();
+	}
+
+	int page = pageOfRow(index.row());
+	_lastReadPage = page;
+
+	QHash<int, ParseRows>::const_iterator i = _pages.constFind(page);
+	if (i == _pages.constEnd()) {
+		// the page was evicted, it is fetched again and reported through dataChanged
+		const_cast<ParseQueryModel *>(this)->requestPage(page);
+		return QVariant();
+	}
+
+	const ParseRows &rows = i.value();
+	int row = index.row() - _pageStarts.at(page);
+
+	switch (role) {
+	case ObjectRole:
+		return QVariant::fromValue(static_cast<QObject *>(rowObject(page, row)));
+	case Qt::DisplayRole:
+	case ObjectIdRole:
+		return rows.objectId(row);
+	case CreatedAtRole:
+		return ParseManager::dateTimeFromString(rows.json(row).value("createdAt").toString());
+	case UpdatedAtRole:
+		return ParseManager::dateTimeFromString(rows.json(row).value("updatedAt").toString());
+	default:
+		if (role >= FirstKeyRole && role < FirstKeyRole + _keys.size()) {
+			return rows.value(row, _keys.at(role - FirstKeyRole));
+		}
+		return QVariant();
+	}
+}
+
+bool ParseQueryModel::canFetchMore(const QModelIndex &parent) const
+{
+	return !parent.isValid() && _query && !_atEnd && !_pendingPages.contains(_pageSizes.size());
+}
+
+void ParseQueryModel::fetchMore(const QModelIndex &parent)
+{
+	if (canFetchMore(parent)) {
+		requestPage(_pageSizes.size());
+	}
+}
+
+void ParseQueryModel::pageFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	// replies to requests from before the last reset, or received twice, are dropped
+	QHash<QByteArray, int>::iterator i = _pendingRequests.find(reply->url().toEncoded());
+	if (i == _pendingRequests.end()) {
+		return;
+	}
+	int page = i.value();
+	_pendingRequests.erase(i);
+	_pendingPages.remove(page);
+	setBusy(!_pendingPages.isEmpty());
+
+	if (page > _pageSizes.size()) {
+		return;
+	}
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	if (!json.isValid()) {
+		Q_EMIT loadFailed(error);
+		error->deleteLater();
+		return;
+	}
+
+	QVariantList jsonRows = json.toMap().value("results").toList();
+	if (page == _pageSizes.size()) {
+		appendPage(jsonRows);
+	}
+	else if (_pages.contains(page)) {
+		mergePage(page, jsonRows);
+	}
+	else {
+		reloadPage(page, jsonRows);
+	}
+
+	// only the last page may be short, more can be fetched once it is full
+	if (page == _pageSizes.size() - 1) {
+		_atEnd = _pageSizes.last() < _pageSize;
+		if (!_pageSizes.last()) {
+			_pageSizes.removeLast();
+			_pageStarts.removeLast();
+			_pageCursors.removeLast();
+			_pageTies.removeLast();
+			_pageHeads.removeLast();
+			_pages.remove(page);
+		}
+	}
+
+	evictPages();
+}
+
+void ParseQueryModel::clear()
+{
+	beginResetModel();
+	_pageSizes.clear();
+	_pageStarts.clear();
+	_pageCursors.fill(QDateTime(), 1);
+	_pageTies.fill(QVariantList(), 1);
+	_pageHeads.clear();
+	_rowCount = 0;
+	_pages.clear();
+	foreach (int page, _pageObjects.keys()) {
+		releaseObjects(page);
+	}
+	_pendingPages.clear();
+	_pendingRequests.clear();
+	_atEnd = false;
+	_lastReadPage = 0;
+	endResetModel();
+
+	setBusy(false);
+	Q_EMIT countChanged();
+}
+
+void ParseQueryModel::requestPage(int page)
+{
+	if (!_query || _pendingPages.contains(page)) {
+		return;
+	}
+	Q_ASSERT(!_query->className().isEmpty());
+
+	// the range of the page: at or after its start, but without the objects of the pages before
+	// created at that time, and for all but the last page up to the start of the next one
+	QVariantMap where = _query->_where;
+	QVariantMap createdAt = where.value("createdAt").toMap();
+	QVariantMap objectId = where.value("objectId").toMap();
+	QVariantList excluded = objectId.value("$nin").toList() + _pageTies.at(page);
+	int limit = _pageSize;
+
+	if (_pageCursors.at(page).isValid()) {
+		createdAt.insert("$gte", _pageCursors.at(page));
+	}
+	if (page < _pageSizes.size() - 1) {
+		createdAt.insert("$lte", _pageCursors.at(page + 1));
+		excluded += _pageHeads.at(page + 1);
+		limit = PQ_MODEL_MAX_PAGE_SIZE; // the page may have grown since
+	}
+
+	if (!createdAt.isEmpty()) {
+		where.insert("createdAt", createdAt);
+	}
+	if (!excluded.isEmpty()) {
+		objectId.insert("$nin", excluded);
+		where.insert("objectId", objectId);
+	}
+
+	QVariantMap entry;
+	entry.insert("order", Qt::AscendingOrder);
+	entry.insert("key", "createdAt");
+	QVariantList order;
+	order.append(entry);
+
+	ParseError *error = NULL;
+	QVariant data(_query->encodeConstraints(where, order, limit, 0, false, &error));
+
+	QString path = "classes/" + _query->className();
+	if (data.isValid()) {
+		error = ParseManager::instance()->request(QNetworkAccessManager::GetOperation,
+												  path,
+												  data,
+												  this, SLOT(pageFinished()));
+	}
+
+	if (error) {
+		Q_EMIT loadFailed(error);
+		error->deleteLater();
+		return;
+	}
+
+	// the reply is recognized by its url, which tells the class, keys, page size and range
+	QUrl url = ParseManager::instance()->serverUrl().resolved(QUrl(path));
+	url.setEncodedQuery(data.toByteArray());
+
+	_pendingRequests.insert(url.toEncoded(), page);
+	_pendingPages.insert(page);
+	setBusy(true);
+}
+
+void ParseQueryModel::appendPage(const QVariantList &jsonRows)
+{
+	if (jsonRows.isEmpty()) {
+		_atEnd = true;
+		return;
+	}
+
+	int page = _pageSizes.size();
+
+	beginInsertRows(QModelIndex(), _rowCount, _rowCount + jsonRows.size() - 1);
+	_pageSizes.append(0);
+	_pageStarts.append(_rowCount);
+	_pageCursors.append(QDateTime());
+	_pageTies.append(QVariantList());
+	_pageHeads.append(QVariantList());
+	setPageRows(page, jsonRows);
+	endInsertRows();
+
+	_lastReadPage = page;
+	Q_EMIT countChanged();
+}
+
+void ParseQueryModel::reloadPage(int page, const QVariantList &jsonRows)
+{
+	// the rows of an evicted page are unknown, so they are only adjusted in number
+	int first = _pageStarts.at(page);
+	int oldSize = _pageSizes.at(page);
+	int newSize = jsonRows.size();
+
+	if (newSize < oldSize) {
+		beginRemoveRows(QModelIndex(), first + newSize, first + oldSize - 1);
+		setPageRows(page, jsonRows);
+		endRemoveRows();
+		Q_EMIT countChanged();
+	}
+	else if (newSize > oldSize) {
+		beginInsertRows(QModelIndex(), first + oldSize, first + newSize - 1);
+		setPageRows(page, jsonRows);
+		endInsertRows();
+		Q_EMIT countChanged();
+	}
+	else {
+		setPageRows(page, jsonRows);
+	}
+
+	if (qMin(newSize, oldSize) > 0) {
+		Q_EMIT dataChanged(index(first), index(first + qMin(newSize, oldSize) - 1));
+	}
+	_lastReadPage = page;
+}
+
+void ParseQueryModel::mergePage(int page, const QVariantList &jsonRows)
+{
+	QVariantList rows = _pages.value(page).jsonRows();
+
+	QSet<QString> objectIds;
+	foreach (const QVariant &jsonRow, jsonRows) {
+		objectIds.insert(objectIdOf(jsonRow));
+	}
+
+	// remove the rows no longer in the page, from the back so that indexes stay valid
+	for (int last = rows.size() - 1; last >= 0; --last) {
+		if (objectIds.contains(objectIdOf(rows.at(last)))) {
+			continue;
+		}
+		int first = last;
+		while (first > 0 && !objectIds.contains(objectIdOf(rows.at(first - 1)))) {
+			--first;
+		}
+		removeRows(page, &rows, first, last);
+		last = first;
+	}
+
+	// then walk the page in its new order - new rows are inserted, moved rows removed and inserted again
+	int i = 0;
+	while (i < jsonRows.size()) {
+		QString objectId = objectIdOf(jsonRows.at(i));
+
+		if (i < rows.size() && objectIdOf(rows.at(i)) == objectId) {
+			if (rows.at(i).toMap().value("updatedAt") != jsonRows.at(i).toMap().value("updatedAt")) {
+				rows[i] = jsonRows.at(i);
+				setPageRows(page, rows);
+
+				QModelIndex changed = index(_pageStarts.at(page) + i);
+				Q_EMIT dataChanged(changed, changed);
+			}
+			++i;
+		}
+		else if (indexOfObjectId(rows, objectId, i) < 0) {
+			insertRow(page, &rows, i, jsonRows.at(i));
+			++i;
+		}
+		else {
+			removeRows(page, &rows, i, i);
+		}
+	}
+
+	if (rows.size() > jsonRows.size()) {
+		removeRows(page, &rows, jsonRows.size(), rows.size() - 1);
+	}
+}
+
+void ParseQueryModel::evictPages()
+{
+	int maxPages = qMax(2, (_windowSize + _pageSize - 1) / _pageSize);
+
+	while (_pages.size() > maxPages) {
+		int farthest = -1;
+		foreach (int page, _pages.keys()) {
+			if (farthest < 0 || qAbs(page - _lastReadPage) > qAbs(farthest - _lastReadPage)) {
+				farthest = page;
+			}
+		}
+		_pages.remove(farthest);
+		releaseObjects(farthest);
+	}
+}
+
+void ParseQueryModel::insertRow(int page, QVariantList *rows, int at, const QVariant &jsonRow)
+{
+	int row = _pageStarts.at(page) + at;
+
+	beginInsertRows(QModelIndex(), row, row);
+	rows->insert(at, jsonRow);
+	setPageRows(page, *rows);
+	endInsertRows();
+
+	Q_EMIT countChanged();
+}
+
+void ParseQueryModel::removeRows(int page, QVariantList *rows, int first, int last)
+{
+	int start = _pageStarts.at(page);
+
+	beginRemoveRows(QModelIndex(), start + first, start + last);
+	rows->erase(rows->begin() + first, rows->begin() + last + 1);
+	setPageRows(page, *rows);
+	endRemoveRows();
+
+	Q_EMIT countChanged();
+}
+
+void ParseQueryModel::setPageRows(int page, const QVariantList &jsonRows)
+{
+	_pages.insert(page, ParseRows(_query ? _query->className() : QString(), jsonRows,
+								  _query && !_query->selectedKeys().isEmpty()));
+
+	_pageSizes[page] = jsonRows.size();
+
+	// the objects created when the page starts, which the page before must leave out
+	QString start = ParseManager::stringFromDateTime(_pageCursors.at(page));
+	QVariantList &heads = _pageHeads[page];
+	heads.clear();
+	for (int i = 0; i < jsonRows.size() && createdAtOf(jsonRows.at(i)) == start; ++i) {
+		heads.append(objectIdOf(jsonRows.at(i)));
+	}
+
+	// the next page to load starts after the newest object, like the pages of findAll - only the
+	// end of the last page moves, the bounds between loaded pages stay so that rows don't move
+	if (page == _pageSizes.size() - 1) {
+		QDateTime cursor = _pageCursors.at(page);
+		QVariantList ties = _pageTies.at(page);
+		if (!jsonRows.isEmpty()) {
+			QString cursorString = createdAtOf(jsonRows.last());
+			if (cursorString != start) {
+				cursor = ParseManager::dateTimeFromString(cursorString);
+				ties.clear();
+			}
+			for (int i = jsonRows.size() - 1; i >= 0 && createdAtOf(jsonRows.at(i)) == cursorString; --i) {
+				ties.append(objectIdOf(jsonRows.at(i)));
+			}
+		}
+		_pageCursors[page + 1] = cursor;
+		_pageTies[page + 1] = ties;
+	}
+
+	for (int i = page + 1; i < _pageStarts.size(); ++i) {
+		_pageStarts[i] = _pageStarts.at(i - 1) + _pageSizes.at(i - 1);
+	}
+	_rowCount = _pageStarts.last() + _pageSizes.last();
+}
+
+int ParseQueryModel::pageOfRow(int row) const
+{
+	QVector<int>::const_iterator i = qUpperBound(_pageStarts.constBegin(), _pageStarts.constEnd(), row);
+	return int(i - _pageStarts.constBegin()) - 1;
+}
+
+ParseObject *ParseQueryModel::rowObject(int page, int row) const
+{
+	const ParseRows rows = _pages.value(page);
+	bool loaded = ParseManager::instance()->registeredObject(rows.className(), rows.objectId(row));
+	ParseObject *object = rows.at(row);
+
+	// objects created here belong to the model, objects loaded before to their owners
+	if (!loaded) {
+		object->setParent(const_cast<ParseQueryModel *>(this));
+		_pageObjects[page].append(object);
+	}
+	return object;
+}
+
+void ParseQueryModel::releaseObjects(int page)
+{
+	QList<QPointer<ParseObject> > objects = _pageObjects.take(page);
+	if (objects.isEmpty()) {
+		return;
+	}
+
+	// rows may have moved to another page since their object was created
+	QHash<QString, int> keptPages;
+	for (QHash<int, ParseRows>::const_iterator i = _pages.constBegin(); i != _pages.constEnd(); ++i) {
+		for (int row = 0; i.key() != page && row < i.value().size(); ++row) {
+			keptPages.insert(i.value().objectId(row), i.key());
+		}
+	}
+
+	foreach (const QPointer<ParseObject> &object, objects) {
+		// objects taken over by the application or still saving are left alone
+		if (!object || object->parent() != this || object->busy()) {
+			continue;
+		}
+
+		QHash<QString, int>::const_iterator kept = keptPages.constFind(object->objectId());
+		if (kept != keptPages.constEnd()) {
+			_pageObjects[kept.value()].append(object);
+		}
+		else {
+			// views may still hold the object until they are updated
+			object->deleteLater();
+		}
+	}
+}
+
+void ParseQueryModel::updateRoleNames()
+{
+	QHash<int, QByteArray> roles;
+	roles.insert(ObjectRole, "object");
+	roles.insert(ObjectIdRole, "objectId");
+	roles.insert(CreatedAtRole, "createdAt");
+	roles.insert(UpdatedAtRole, "updatedAt");
+	for (int i = 0; i < _keys.size(); ++i) {
+		roles.insert(FirstKeyRole + i, _keys.at(i).toUtf8());
+	}
+	setRoleNames(roles);
+}
+
+void ParseQueryModel::setBusy(bool busy)
+{
+	if (busy != _busy) {
+		_busy = busy;
+		Q_EMIT busyChanged(_busy);
+	}
+}
+
+} /* namespace parseqt */
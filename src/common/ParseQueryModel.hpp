@@ -0,0 +1,138 @@
+/*
+ * ParseQueryModel.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_QUERY_MODEL_HPP_
+#define PARSEQT__PARSE_QUERY_MODEL_HPP_
+
+#include "ParseRows.hpp"
+
+#include <QAbstractListModel>
+#include <QDateTime>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+namespace parseqt {
+
+class ParseQuery;
+class ParseObject;
+class ParseError;
+
+/// List model of the results of a query, loaded page by page as the view asks for more.
+/// Only the pages of up to windowSize rows around the rows last read are kept, others are
+/// fetched again when read. Refreshing fetches the kept pages again and reports the rows which
+/// were inserted, removed or changed, instead of resetting the model.
+/// Rows are ordered by createdAt as in findAll, other orderings of the query are ignored. Every
+/// page is the range of creation times from its first row to the first row of the next page, so
+/// that pages are requested without slow skips and objects created or deleted in one page don't
+/// shift the others.
+/// Roles are "object" (the ParseObject, created on first access), "objectId", "createdAt",
+/// "updatedAt" and one for each of keys, which are read without creating objects.
+/// Objects created by the model are its children and are deleted when their page is dropped,
+/// unless they were given another parent, are still saving or are in another page kept.
+/// Objects loaded before, e.g. by a query, are left to their owners.
+
+class ParseQueryModel : public QAbstractListModel {
+	Q_OBJECT
+	Q_PROPERTY(parseqt::ParseQuery *query READ query WRITE setQuery FINAL)
+	Q_PROPERTY(QStringList keys READ keys WRITE setKeys FINAL)
+	Q_PROPERTY(int pageSize READ pageSize WRITE setPageSize FINAL)
+	Q_PROPERTY(int windowSize READ windowSize WRITE setWindowSize FINAL)
+	Q_PROPERTY(int count READ count NOTIFY countChanged FINAL)
+	Q_PROPERTY(bool busy READ busy NOTIFY busyChanged FINAL)
+
+public:
+	enum Role {
+		ObjectRole = Qt::UserRole + 1,
+		ObjectIdRole,
+		CreatedAtRole,
+		UpdatedAtRole,
+		FirstKeyRole
+	};
+
+	explicit ParseQueryModel(QObject *parent = 0);
+	virtual ~ParseQueryModel();
+
+	/// configuration - changing it empties the model
+	ParseQuery *query() const;
+	void setQuery(ParseQuery *query);
+	QStringList keys() const;
+	void setKeys(const QStringList &keys);
+	int pageSize() const; // at most 1000
+	void setPageSize(int pageSize);
+	int windowSize() const;
+	void setWindowSize(int windowSize);
+
+	int count() const;
+	Q_SIGNAL void countChanged();
+
+	bool busy() const;
+	Q_SIGNAL void busyChanged(bool busy);
+
+	/// loading - reload starts over with the first page, loadMore is fetchMore for QML
+	Q_INVOKABLE void reload();
+	Q_INVOKABLE void loadMore();
+	Q_INVOKABLE void refresh();
+	Q_SIGNAL void loadFailed(parseqt::ParseError *error);
+
+	/// the object of a row, or NULL if its page is not loaded - see above for its lifetime
+	Q_INVOKABLE parseqt::ParseObject *get(int row);
+
+	/// QAbstractListModel
+	virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+	virtual bool canFetchMore(const QModelIndex &parent) const;
+	virtual void fetchMore(const QModelIndex &parent);
+
+private:
+	Q_DISABLE_COPY(ParseQueryModel)
+
+	Q_SLOT void pageFinished();
+
+	void clear();
+	void requestPage(int page);
+	void appendPage(const QVariantList &jsonRows);
+	void reloadPage(int page, const QVariantList &jsonRows);
+	void mergePage(int page, const QVariantList &jsonRows);
+	void evictPages();
+
+	void insertRow(int page, QVariantList *rows, int at, const QVariant &jsonRow);
+	void removeRows(int page, QVariantList *rows, int first, int last);
+	void setPageRows(int page, const QVariantList &jsonRows);
+	int pageOfRow(int row) const;
+
+	ParseObject *rowObject(int page, int row) const;
+	void releaseObjects(int page);
+
+	void updateRoleNames();
+	void setBusy(bool busy);
+
+private:
+	QPointer<ParseQuery> _query;
+	QStringList _keys;
+	int _pageSize;
+	int _windowSize;
+	QVector<int> _pageSizes; // rows of every page loaded so far, kept or not
+	QVector<int> _pageStarts; // first row of every page
+	QVector<QDateTime> _pageCursors; // createdAt of the first row of every page and of the next page to load
+	QVector<QVariantList> _pageTies; // objectIds created at that time in the pages before
+	QVector<QVariantList> _pageHeads; // objectIds created at that time in the page itself
+	int _rowCount;
+	QHash<int, ParseRows> _pages; // the pages kept
+	mutable QHash<int, QList<QPointer<ParseObject> > > _pageObjects; // objects created by the model, by page
+	QSet<int> _pendingPages;
+	QHash<QByteArray, int> _pendingRequests; // page by request url
+	bool _atEnd;
+	bool _busy;
+	mutable int _lastReadPage;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_QUERY_MODEL_HPP_ */
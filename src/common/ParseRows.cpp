@@ -0,0 +1,131 @@
+/*
+ * ParseRows.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseRows.hpp"
+
+#include "ParseObject.hpp"
+#include "internal/ParseManager.hpp"
+#include "ParseError.hpp"
+
+#include <QPointer>
+#include <QVector>
+
+namespace parseqt {
+
+class ParseRowsData : public QSharedData {
+public:
+	ParseRowsData() : partial(false) { }
+
+	QString className;
+	QVariantList rows;
+	bool partial;
+
+	/// the objects created so far, shared by all copies
+	mutable QVector<QPointer<ParseObject> > objects;
+};
+
+ParseRows::ParseRows() : d(new ParseRowsData) { }
+
+ParseRows::ParseRows(const QString &className, const QVariantList &jsonRows, bool partial) : d(new ParseRowsData)
+{
+	d->className = className;
+	d->rows = jsonRows;
+	d->partial = partial;
+}
+
+ParseRows::ParseRows(const ParseRows &other) : d(other.d) { }
+
+ParseRows &ParseRows::operator=(const ParseRows &other)
+{
+	d = other.d;
+	return *this;
+}
+
+ParseRows::~ParseRows() { }
+
+QString ParseRows::className() const
+{
+	return d->className;
+}
+
+int ParseRows::size() const
+{
+	return d->rows.size();
+}
+
+bool ParseRows::isEmpty() const
+{
+	return d->rows.isEmpty();
+}
+
+QString ParseRows::objectId(int index) const
+{
+	Q_ASSERT(index >= 0 && index < size());
+
+	return d->rows.at(index).toMap().value("objectId").toString();
+}
+
+QVariant ParseRows::value(int index, const QString &key) const
+{
+	Q_ASSERT(index >= 0 && index < size());
+
+	const QVariantMap row = d->rows.at(index).toMap();
+
+	// an existing object may hold newer values than the row, unless the row was fetched later
+	ParseObject *object = index < d->objects.size() ? d->objects.at(index).data() : NULL;
+	if (!object) {
+		object = ParseManager::instance()->registeredObject(d->className, row.value("objectId").toString());
+	}
+	if (object && object->updatedAt() >= ParseManager::dateTimeFromString(row.value("updatedAt").toString())) {
+		return object->value(key);
+	}
+
+	ParseError *error = NULL;
+	QVariant result = ParseManager::instance()->objectify(row.value(key), &error);
+	delete error;
+	return result;
+}
+
+QVariantMap ParseRows::json(int index) const
+{
+	Q_ASSERT(index >= 0 && index < size());
+
+	return d->rows.at(index).toMap();
+}
+
+QVariantList ParseRows::jsonRows() const
+{
+	return d->rows;
+}
+
+ParseObject *ParseRows::at(int index) const
+{
+	Q_ASSERT(index >= 0 && index < size());
+
+	if (d->objects.size() != d->rows.size()) {
+		d->objects.resize(d->rows.size());
+	}
+
+	QPointer<ParseObject> &object = d->objects[index];
+	if (!object) {
+		object = ParseObject::objectFromJson(d->className, d->rows.at(index).toMap(), d->partial);
+	}
+	return object;
+}
+
+QVariantList ParseRows::toList() const
+{
+	QVariantList result;
+	result.reserve(size());
+
+	for (int i = 0; i < size(); ++i) {
+		result.append(QVariant::fromValue(at(i)));
+	}
+	return result;
+}
+
+} /* namespace parseqt */
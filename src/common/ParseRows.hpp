@@ -0,0 +1,56 @@
+/*
+ * ParseRows.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_ROWS_HPP_
+#define PARSEQT__PARSE_ROWS_HPP_
+
+#include <QMetaType>
+#include <QSharedDataPointer>
+#include <QVariant>
+
+namespace parseqt {
+
+class ParseObject;
+class ParseRowsData;
+
+/// Query results as an implicitly shared list of json rows - copying is cheap and no ParseObject
+/// is created until a row is accessed with at, which returns the same object on every call.
+/// Values can be read without creating objects; they reflect the object once it was created.
+
+class ParseRows {
+public:
+	ParseRows();
+	ParseRows(const QString &className, const QVariantList &jsonRows, bool partial = false);
+	ParseRows(const ParseRows &other);
+	ParseRows &operator=(const ParseRows &other);
+	~ParseRows();
+
+	QString className() const;
+	int size() const;
+	bool isEmpty() const;
+
+	/// reading rows without creating objects
+	QString objectId(int index) const;
+	QVariant value(int index, const QString &key) const;
+	QVariantMap json(int index) const;
+	QVariantList jsonRows() const;
+
+	/// the object of a row, created on first access
+	ParseObject *at(int index) const;
+
+	/// all objects, as findObjects reports them without lazy results
+	QVariantList toList() const;
+
+private:
+	QSharedDataPointer<ParseRowsData> d;
+};
+
+} /* namespace parseqt */
+
+Q_DECLARE_METATYPE(parseqt::ParseRows);
+
+#endif /* PARSEQT__PARSE_ROWS_HPP_ */
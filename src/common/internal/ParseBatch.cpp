@@ -0,0 +1,169 @@
+/*
+ * ParseBatch.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseBatch.hpp"
+
+#include "ParseManager.hpp"
+#include "ParseObject.hpp"
+#include "ParseError.hpp"
+
+#include <QtNetwork/QNetworkReply>
+
+#define PQ_BATCH_SIZE	50 // maximum number of operations the batch endpoint accepts per request
+
+namespace parseqt {
+
+ParseBatch::ParseBatch(Action action, const QList<ParseObject *> &objects, QObject *parent)
+	: QObject(parent), _action(action), _succeeded(true), _error(NULL)
+{
+	foreach (ParseObject *object, objects) {
+		Q_ASSERT(object);
+		Q_ASSERT(!object->className().isEmpty());
+
+		if (object->busy()) {
+			continue;
+		}
+		object->setBusy(true);
+		object->_retries = 0;
+		_pending.append(object);
+	}
+}
+
+ParseBatch::~ParseBatch() { }
+
+void ParseBatch::start()
+{
+	sendChunk();
+}
+
+void ParseBatch::sendChunk()
+{
+	QVariantList requests;
+	_chunk.clear();
+
+	while (!_pending.isEmpty() && requests.size() < PQ_BATCH_SIZE) {
+		QPointer<ParseObject> object = _pending.takeFirst();
+		if (!object) {
+			continue;
+		}
+
+		ParseError *error = NULL;
+		QVariant request = _action == ActionSave ? object->saveRequest(&error) : object->eraseRequest();
+		if (!request.isValid()) {
+			completeObject(object, QVariantMap(), error);
+			error->deleteLater();
+			continue;
+		}
+
+		_chunk.append(object);
+		requests.append(request);
+	}
+
+	if (requests.isEmpty()) {
+		finish();
+		return;
+	}
+
+	QVariantMap body;
+	body.insert("requests", requests);
+
+	ParseError *error = ParseManager::instance()->request(QNetworkAccessManager::PostOperation,
+														  "batch",
+														  body,
+														  this, SLOT(chunkFinished()), 0,
+														  ParseScheduler::PriorityBackground);
+	if (error) {
+		failChunk(error);
+		sendChunk();
+	}
+}
+
+void ParseBatch::chunkFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	int retries = ParseScheduler::retries(reply);
+	foreach (const QPointer<ParseObject> &object, _chunk) {
+		if (object) {
+			object->_retries = retries;
+		}
+	}
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	QVariantList results = json.toList();
+
+	if (!error && results.size() != _chunk.size()) {
+		error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInternal, "unexpected batch reply");
+	}
+
+	if (error) {
+		failChunk(error);
+		sendChunk();
+		return;
+	}
+
+	for (int i = 0; i < _chunk.size(); ++i) {
+		QVariantMap result = results.at(i).toMap();
+
+		if (result.contains("success")) {
+			completeObject(_chunk.at(i), result.value("success").toMap(), NULL);
+		}
+		else {
+			QVariantMap errorMap = result.value("error").toMap();
+			ParseError *objectError = new ParseError(ParseError::DomainParse, errorMap.value("code").toInt(), errorMap.value("error").toString());
+			completeObject(_chunk.at(i), QVariantMap(), objectError);
+			objectError->deleteLater();
+		}
+	}
+
+	sendChunk();
+}
+
+void ParseBatch::completeObject(ParseObject *object, const QVariantMap &json, ParseError *error)
+{
+	if (error) {
+		_succeeded = false;
+	}
+	if (!object) {
+		return;
+	}
+
+	if (_action == ActionSave) {
+		object->completeSave(json, error);
+	}
+	else {
+		object->completeErase(error);
+	}
+}
+
+void ParseBatch::failChunk(ParseError *error)
+{
+	foreach (const QPointer<ParseObject> &object, _chunk) {
+		completeObject(object, QVariantMap(), error);
+	}
+	_chunk.clear();
+
+	// keep the first request level error to report it on completion
+	if (!_error) {
+		_error = error;
+		_error->setParent(this);
+	}
+	else {
+		error->deleteLater();
+	}
+	_succeeded = false;
+}
+
+void ParseBatch::finish()
+{
+	Q_EMIT completed(_succeeded, _error);
+	deleteLater();
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,61 @@
+/*
+ * ParseBatch.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_BATCH_HPP_
+#define PARSEQT__PARSE_BATCH_HPP_
+
+#include <QObject>
+#include <QPointer>
+
+namespace parseqt {
+
+class ParseObject;
+class ParseError;
+
+/// Internal class - use ParseObject::saveAll/eraseAll instead
+
+/// Sends the objects in chunks to the batch endpoint and reports the outcome
+/// to each object through its own saveCompleted/eraseCompleted signal.
+/// Deletes itself after emitting completed.
+
+class ParseBatch : public QObject {
+	Q_OBJECT
+
+public:
+	enum Action {
+		ActionSave,
+		ActionErase
+	};
+
+	ParseBatch(Action action, const QList<ParseObject *> &objects, QObject *parent = 0);
+	virtual ~ParseBatch();
+
+	void start();
+
+	Q_SIGNAL void completed(bool succeeded, parseqt::ParseError *error);
+
+private:
+	Q_DISABLE_COPY(ParseBatch)
+
+	Q_SLOT void chunkFinished();
+
+	void sendChunk();
+	void completeObject(ParseObject *object, const QVariantMap &json, ParseError *error);
+	void failChunk(ParseError *error);
+	void finish();
+
+private:
+	Action _action;
+	QList<QPointer<ParseObject> > _pending;
+	QList<QPointer<ParseObject> > _chunk;
+	bool _succeeded;
+	ParseError *_error;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_BATCH_HPP_ */
@@ -0,0 +1,255 @@
+/*
+ * ParseCache.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseCache.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+
+#define PQ_CACHE_DEFAULT_MAX_SIZE	(4 * 1024 * 1024)
+#define PQ_CACHE_INDEX_NAME	"index" // entries are named by hex digits only
+
+namespace parseqt {
+
+ParseCache::ParseCache() : _maxSize(PQ_CACHE_DEFAULT_MAX_SIZE), _size(0), _loaded(false), _indexChanged(false) { }
+
+ParseCache::~ParseCache()
+{
+	saveIndex();
+}
+
+QString ParseCache::directory() const
+{
+	return _directory;
+}
+
+void ParseCache::setDirectory(const QString &directory)
+{
+	if (directory != _directory) {
+		saveIndex();
+		_directory = directory;
+		_loaded = false;
+	}
+}
+
+qint64 ParseCache::maxSize() const
+{
+	return _maxSize;
+}
+
+void ParseCache::setMaxSize(qint64 maxSize)
+{
+	Q_ASSERT(maxSize >= 0);
+
+	_maxSize = maxSize;
+	if (_loaded) {
+		evict();
+	}
+}
+
+bool ParseCache::lookup(const QString &key, int maxAge, QByteArray *data)
+{
+	Q_ASSERT(data);
+
+	load();
+
+	QString name = fileName(key);
+	if (!_sizes.contains(name) || !isFresh(name, maxAge)) {
+		return false;
+	}
+
+	QFile file(filePath(name));
+	if (!file.open(QIODevice::ReadOnly)) {
+		removeEntry(name);
+		return false;
+	}
+	*data = file.readAll();
+	file.close();
+
+	_recent.removeOne(name);
+	_recent.prepend(name);
+	_indexChanged = true;
+
+	return true;
+}
+
+bool ParseCache::contains(const QString &key, int maxAge)
+{
+	load();
+
+	QString name = fileName(key);
+	return _sizes.contains(name) && isFresh(name, maxAge);
+}
+
+bool ParseCache::insert(const QString &key, const QByteArray &data)
+{
+	load();
+
+	QString name = fileName(key);
+	removeEntry(name);
+
+	if (data.size() > _maxSize) {
+		return false;
+	}
+
+	QFile file(filePath(name));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+		file.remove();
+		return false;
+	}
+
+	_sizes.insert(name, data.size());
+	_recent.prepend(name);
+	_size += data.size();
+	_indexChanged = true;
+
+	evict();
+	saveIndex();
+	return true;
+}
+
+void ParseCache::remove(const QString &key)
+{
+	load();
+
+	removeEntry(fileName(key));
+	saveIndex();
+}
+
+void ParseCache::clear()
+{
+	load();
+
+	foreach (const QString &name, _recent) {
+		QFile::remove(filePath(name));
+	}
+	_sizes.clear();
+	_recent.clear();
+	_size = 0;
+	_indexChanged = true;
+
+	saveIndex();
+}
+
+void ParseCache::load()
+{
+	if (_loaded) {
+		return;
+	}
+	_loaded = true;
+
+	_sizes.clear();
+	_recent.clear();
+	_size = 0;
+
+	QDir dir(_directory);
+	if (!dir.exists() && !dir.mkpath(".")) {
+		return;
+	}
+
+	// newest first
+	QFileInfoList infos = dir.entryInfoList(QDir::Files, QDir::Time);
+	foreach (const QFileInfo &info, infos) {
+		if (!info.fileName().startsWith(PQ_CACHE_INDEX_NAME)) {
+			_sizes.insert(info.fileName(), info.size());
+			_size += info.size();
+		}
+	}
+
+	// recover the usage order of the previous run from its index
+	QSet<QString> indexed;
+	QFile index(filePath(PQ_CACHE_INDEX_NAME));
+	if (index.open(QIODevice::ReadOnly)) {
+		foreach (const QByteArray &line, index.readAll().split('\n')) {
+			QString name = QString::fromLatin1(line);
+			if (_sizes.contains(name) && !indexed.contains(name)) {
+				indexed.insert(name);
+				_recent.append(name);
+			}
+		}
+	}
+
+	// entries written after the index was saved, e.g. before a crash, were used last
+	QStringList newer;
+	foreach (const QFileInfo &info, infos) {
+		if (_sizes.contains(info.fileName()) && !indexed.contains(info.fileName())) {
+			newer.append(info.fileName());
+		}
+	}
+	_recent = newer + _recent;
+	_indexChanged = !newer.isEmpty();
+
+	evict();
+	saveIndex();
+}
+
+void ParseCache::evict()
+{
+	while (_size > _maxSize && !_recent.isEmpty()) {
+		removeEntry(_recent.last());
+	}
+}
+
+bool ParseCache::isFresh(const QString &name, int maxAge) const
+{
+	if (maxAge <= 0) {
+		return true;
+	}
+
+	QFileInfo info(filePath(name));
+	return info.lastModified().secsTo(QDateTime::currentDateTime()) <= maxAge;
+}
+
+void ParseCache::saveIndex()
+{
+	if (!_loaded || !_indexChanged) {
+		return;
+	}
+	_indexChanged = false;
+
+	// written aside and then renamed, so that a failed write leaves the previous index
+	QFile file(filePath(PQ_CACHE_INDEX_NAME ".new"));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(_recent.join("\n").toLatin1()) < 0) {
+		file.remove();
+		return;
+	}
+	file.close();
+
+	QFile::remove(filePath(PQ_CACHE_INDEX_NAME));
+	file.rename(filePath(PQ_CACHE_INDEX_NAME));
+}
+
+QString ParseCache::fileName(const QString &key) const
+{
+	return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+QString ParseCache::filePath(const QString &name) const
+{
+	return _directory + "/" + name;
+}
+
+void ParseCache::removeEntry(const QString &name)
+{
+	QHash<QString, qint64>::iterator i = _sizes.find(name);
+	if (i == _sizes.end()) {
+		return;
+	}
+
+	_size -= i.value();
+	_sizes.erase(i);
+	_recent.removeOne(name);
+	_indexChanged = true;
+
+	QFile::remove(filePath(name));
+}
+
+} /* namespace parseqt */
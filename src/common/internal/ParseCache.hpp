@@ -0,0 +1,63 @@
+/*
+ * ParseCache.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_CACHE_HPP_
+#define PARSEQT__PARSE_CACHE_HPP_
+
+#include <QHash>
+#include <QStringList>
+
+namespace parseqt {
+
+/// Internal class - size bounded on-disk store for raw replies with least recently used eviction.
+/// Every entry is kept in its own file named after the hash of its key, its modification time
+/// tells its age. The usage order is kept in an index file so that it survives restarts - it is
+/// saved by the writes and on destruction rather than on every lookup.
+
+class ParseCache {
+public:
+	ParseCache();
+	~ParseCache();
+
+	/// configuration
+	QString directory() const;
+	void setDirectory(const QString &directory);
+	qint64 maxSize() const;
+	void setMaxSize(qint64 maxSize);
+
+	/// access - maxAge is in seconds, entries of any age are returned for maxAge <= 0
+	/// insert returns false if the entry was not stored, being larger than maxSize or not writable
+	bool lookup(const QString &key, int maxAge, QByteArray *data);
+	bool contains(const QString &key, int maxAge);
+	bool insert(const QString &key, const QByteArray &data);
+	void remove(const QString &key);
+	void clear();
+
+private:
+	Q_DISABLE_COPY(ParseCache)
+
+	void load();
+	void evict();
+	bool isFresh(const QString &name, int maxAge) const;
+	void saveIndex();
+	QString fileName(const QString &key) const;
+	QString filePath(const QString &name) const;
+	void removeEntry(const QString &name);
+
+private:
+	QString _directory;
+	qint64 _maxSize;
+	qint64 _size;
+	bool _loaded;
+	QHash<QString, qint64> _sizes;
+	QStringList _recent; // most recently used first
+	bool _indexChanged; // _recent differs from the index file
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_CACHE_HPP_ */
@@ -0,0 +1,125 @@
+/*
+ * ParseCompression.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseCompression.hpp"
+
+#include <string.h>
+
+#define PQ_COMPRESSION_CHUNK	16384
+
+namespace parseqt {
+
+ParseInflater::ParseInflater(QObject *parent) : QObject(parent), _initialized(false), _started(false), _finished(false)
+{
+	memset(&_stream, 0, sizeof(_stream));
+}
+
+ParseInflater::~ParseInflater()
+{
+	if (_initialized) {
+		inflateEnd(&_stream);
+	}
+}
+
+bool ParseInflater::begin(bool raw)
+{
+	if (_initialized) {
+		inflateEnd(&_stream);
+	}
+	memset(&_stream, 0, sizeof(_stream));
+
+	// MAX_WBITS + 32 detects gzip and zlib headers, -MAX_WBITS reads headerless deflate streams
+	_initialized = inflateInit2(&_stream, raw ? -MAX_WBITS : MAX_WBITS + 32) == Z_OK;
+	return _initialized;
+}
+
+bool ParseInflater::inflate(const QByteArray &data, QByteArray *output)
+{
+	Q_ASSERT(output);
+
+	if (_finished || data.isEmpty()) {
+		return true;
+	}
+	if (!_initialized && !begin(false)) {
+		return false;
+	}
+
+	char chunk[PQ_COMPRESSION_CHUNK];
+
+	_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+	_stream.avail_in = data.size();
+
+	for (;;) {
+		_stream.next_out = reinterpret_cast<Bytef *>(chunk);
+		_stream.avail_out = sizeof(chunk);
+
+		int result = ::inflate(&_stream, Z_NO_FLUSH);
+
+		// some servers send deflate encoded bodies without the zlib header
+		if (result == Z_DATA_ERROR && !_started) {
+			if (!begin(true)) {
+				return false;
+			}
+			_started = true;
+			_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+			_stream.avail_in = data.size();
+			continue;
+		}
+		if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+			return false;
+		}
+		_started = true;
+
+		output->append(chunk, sizeof(chunk) - _stream.avail_out);
+
+		if (result == Z_STREAM_END) {
+			_finished = true;
+			return true;
+		}
+		// inflate stops early only when it ran out of output space
+		if (_stream.avail_out != 0) {
+			return true;
+		}
+	}
+}
+
+bool ParseInflater::inflateAll(const QByteArray &data, QByteArray *output)
+{
+	ParseInflater inflater;
+	return inflater.inflate(data, output);
+}
+
+QByteArray gzipCompress(const QByteArray &data)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+
+	// MAX_WBITS + 16 writes a gzip header and trailer
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return QByteArray();
+	}
+
+	QByteArray result;
+	result.resize(deflateBound(&stream, data.size()) + 32);
+
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+	stream.avail_in = data.size();
+	stream.next_out = reinterpret_cast<Bytef *>(result.data());
+	stream.avail_out = result.size();
+
+	int status = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+
+	if (status != Z_STREAM_END) {
+		return QByteArray();
+	}
+
+	result.resize(stream.total_out);
+	return result;
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,50 @@
+/*
+ * ParseCompression.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_COMPRESSION_HPP_
+#define PARSEQT__PARSE_COMPRESSION_HPP_
+
+#include <QObject>
+
+#include <zlib.h>
+
+namespace parseqt {
+
+/// Internal class - inflates gzip or deflate encoded bodies chunk by chunk as they arrive.
+/// Replies own their inflater as a child object, see ParseManager::readReply.
+
+class ParseInflater : public QObject {
+	Q_OBJECT
+
+public:
+	explicit ParseInflater(QObject *parent = 0);
+	virtual ~ParseInflater();
+
+	/// appends the inflated bytes of data to output, returns false on corrupt input
+	bool inflate(const QByteArray &data, QByteArray *output);
+
+	/// inflates a complete body at once
+	static bool inflateAll(const QByteArray &data, QByteArray *output);
+
+private:
+	Q_DISABLE_COPY(ParseInflater)
+
+	bool begin(bool raw);
+
+private:
+	z_stream _stream;
+	bool _initialized;
+	bool _started;
+	bool _finished;
+};
+
+/// gzip compresses data for sending it with content encoding gzip
+QByteArray gzipCompress(const QByteArray &data);
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_COMPRESSION_HPP_ */
@@ -0,0 +1,566 @@
+/*
+ * ParseJournal.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseJournal.hpp"
+
+#include "ParseManager.hpp"
+#include "ParseObject.hpp"
+#include "ParseError.hpp"
+
+#include <QtNetwork/QNetworkReply>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QSet>
+
+#define PQ_JOURNAL_MAGIC	0x50514a31 // "PQJ1"
+#define PQ_JOURNAL_FILE_NAME	"journal"
+#define PQ_JOURNAL_BATCH_SIZE	50
+#define PQ_JOURNAL_RETRY_INTERVAL	30000 // ms until sending again after a failure, unless coming online earlier
+#define PQ_JOURNAL_MIN_DEAD_RECORDS	256 // compaction is not worth it for fewer dead records
+
+namespace parseqt {
+
+static bool isTransientError(int code)
+{
+	return code == ParseError::ParseCodeInternalServerError || code == ParseError::ParseCodeRequestLimitExceeded;
+}
+
+ParseJournal::ParseJournal(QObject *parent)
+	: QObject(parent), _loaded(false), _nextSequence(1), _inFlight(0), _deadRecords(0)
+{
+	_flushTimer.setSingleShot(true);
+	connect(&_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+	connect(&_network, SIGNAL(onlineStateChanged(bool)), this, SLOT(flush()));
+}
+
+ParseJournal::~ParseJournal() { }
+
+QString ParseJournal::directory() const
+{
+	return _directory;
+}
+
+void ParseJournal::setDirectory(const QString &directory)
+{
+	if (directory == _directory) {
+		return;
+	}
+
+	_directory = directory;
+	_file.close();
+	_loaded = false;
+}
+
+ParseError *ParseJournal::enqueue(ParseObject *object, Action action, const QVariantMap &fields)
+{
+	Q_ASSERT(object);
+
+	load();
+	if (!_file.isOpen()) {
+		openFile();
+	}
+
+	QString className = object->className();
+	QString objectId = object->objectId();
+	QString localId = object->_localId;
+
+	// merge with the last queued operation on the object unless it is already being sent
+	int index = findPending(className, objectId, localId);
+	if (index >= 0) {
+		// the queue only changes once the journal file holds the change
+		Operation merged = _operations.at(index);
+
+		if (merged.action == ActionSave && action == ActionSave) {
+			for (QVariantMap::const_iterator i = fields.constBegin(); i != fields.constEnd(); ++i) {
+				merged.fields.insert(i.key(), i.value());
+			}
+			if (!writeOperation(merged)) {
+				return writeError();
+			}
+			_operations[index] = merged;
+			_objects.insert(merged.sequence, object);
+			++_deadRecords;
+			scheduleFlush();
+			return NULL;
+		}
+
+		if (merged.action == ActionSave && action == ActionErase) {
+			if (resolvedObjectId(merged).isEmpty() && isCreate(index)) {
+				// the object never made it to the server, so both operations cancel out
+				if (!writeDone(merged.sequence)) {
+					return writeError();
+				}
+				_operations.removeAt(index);
+				_objects.remove(merged.sequence);
+				_deadRecords += 2;
+
+				object->completeEventually(true, QVariantMap(), NULL);
+				return NULL;
+			}
+
+			// the object exists or is being created, its id is resolved before the erase is sent
+			merged.action = ActionErase;
+			merged.fields.clear();
+			if (!writeOperation(merged)) {
+				return writeError();
+			}
+			_operations[index] = merged;
+			_objects.insert(merged.sequence, object);
+			++_deadRecords;
+			scheduleFlush();
+			return NULL;
+		}
+	}
+
+	if (objectId.isEmpty() && localId.isEmpty()) {
+		localId = QString("local-%1-%2").arg(QDateTime::currentMSecsSinceEpoch()).arg(_nextSequence);
+	}
+
+	Operation operation;
+	operation.sequence = _nextSequence;
+	operation.action = action;
+	operation.className = className;
+	operation.objectId = objectId;
+	operation.localId = localId;
+	operation.fields = fields;
+
+	if (!writeOperation(operation)) {
+		return writeError();
+	}
+	++_nextSequence;
+	object->_localId = localId;
+
+	_operations.append(operation);
+	_objects.insert(operation.sequence, object);
+
+	scheduleFlush();
+	return NULL;
+}
+
+int ParseJournal::pendingCount()
+{
+	load();
+
+	return _operations.size();
+}
+
+void ParseJournal::scheduleFlush()
+{
+	_flushTimer.start(0);
+}
+
+void ParseJournal::flush()
+{
+	load();
+
+	if (_inFlight || _operations.isEmpty()) {
+		return;
+	}
+
+	QVariantList requests;
+	QSet<QString> creating;
+	ParseManager *manager = ParseManager::instance();
+
+	while (requests.size() < _operations.size() && requests.size() < PQ_JOURNAL_BATCH_SIZE) {
+		const Operation &operation = _operations.at(requests.size());
+		QString objectId = resolvedObjectId(operation);
+
+		// an operation on an object created in this batch has to wait for its object id
+		if (objectId.isEmpty() && creating.contains(operation.localId)) {
+			break;
+		}
+
+		QVariantMap request;
+		QString path = "classes/" + operation.className;
+
+		if (operation.action == ActionSave && objectId.isEmpty()) {
+			creating.insert(operation.localId);
+			request.insert("method", "POST");
+			request.insert("body", operation.fields);
+		}
+		else if (operation.action == ActionSave) {
+			path += "/" + objectId;
+			request.insert("method", "PUT");
+			request.insert("body", operation.fields);
+		}
+		else {
+			path += "/" + objectId;
+			request.insert("method", "DELETE");
+		}
+		request.insert("path", manager->batchPath(path));
+
+		requests.append(request);
+	}
+
+	QVariantMap body;
+	body.insert("requests", requests);
+
+	ParseError *error = manager->request(QNetworkAccessManager::PostOperation,
+										 "batch",
+										 body,
+										 this, SLOT(batchFinished()), 0,
+										 ParseScheduler::PriorityBackground);
+	if (error) {
+		delete error;
+		_flushTimer.start(PQ_JOURNAL_RETRY_INTERVAL);
+		return;
+	}
+
+	_inFlight = requests.size();
+}
+
+void ParseJournal::batchFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+	reply->deleteLater();
+
+	ParseError *error = NULL;
+	QVariant json = ParseManager::instance()->retrieveJsonReply(reply, 200, &error);
+	QVariantList results = json.toList();
+
+	if (!error && results.size() != _inFlight) {
+		error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInternal, "unexpected batch reply");
+	}
+
+	if (error) {
+		// nothing is known about the operations, send them again later
+		_inFlight = 0;
+		error->deleteLater();
+		_flushTimer.start(PQ_JOURNAL_RETRY_INTERVAL);
+		return;
+	}
+
+	QList<Operation> retry;
+	QHash<QString, ParseError *> failedCreates; // by local id
+	bool written = true;
+
+	for (int i = 0; i < results.size(); ++i) {
+		Operation operation = _operations.takeFirst();
+		QVariantMap result = results.at(i).toMap();
+
+		if (result.contains("success")) {
+			QVariantMap success = result.value("success").toMap();
+			if (operation.action == ActionSave && resolvedObjectId(operation).isEmpty()) {
+				QString objectId = success.value("objectId").toString();
+				_resolved.insert(operation.localId, objectId);
+				written &= writeResolved(operation.localId, objectId);
+			}
+
+			written &= writeDone(operation.sequence);
+			_deadRecords += 2;
+			complete(operation, success, NULL);
+			continue;
+		}
+
+		QVariantMap errorMap = result.value("error").toMap();
+		int code = errorMap.value("code").toInt();
+		if (isTransientError(code)) {
+			retry.append(operation);
+			continue;
+		}
+
+		// the server refused the operation, it would fail again
+		written &= writeDone(operation.sequence);
+		_deadRecords += 2;
+		ParseError *operationError = new ParseError(ParseError::DomainParse, code, errorMap.value("error").toString());
+		complete(operation, QVariantMap(), operationError);
+		operationError->deleteLater();
+
+		if (operation.action == ActionSave && resolvedObjectId(operation).isEmpty()) {
+			failedCreates.insert(operation.localId, operationError);
+		}
+	}
+
+	// later operations on objects which could not be created would create them instead, or
+	// address no object, so they fail the same way
+	if (!failedCreates.isEmpty()) {
+		for (int i = 0; i < _operations.size(); ) {
+			const Operation &operation = _operations.at(i);
+			ParseError *operationError = failedCreates.value(operation.localId);
+			if (!operationError || !resolvedObjectId(operation).isEmpty()) {
+				++i;
+				continue;
+			}
+			written &= writeDone(operation.sequence);
+			_deadRecords += 2;
+			complete(_operations.takeAt(i), QVariantMap(), operationError);
+		}
+	}
+
+	if (!written) {
+		qWarning() << "ParseJournal: can't record sent operations, they are sent again after a restart:" << _file.errorString();
+	}
+
+	_inFlight = 0;
+	for (int i = retry.size() - 1; i >= 0; --i) {
+		_operations.prepend(retry.at(i));
+	}
+
+	if (_deadRecords > qMax(_operations.size(), PQ_JOURNAL_MIN_DEAD_RECORDS)) {
+		compact();
+	}
+
+	if (retry.isEmpty()) {
+		scheduleFlush();
+	}
+	else {
+		_flushTimer.start(PQ_JOURNAL_RETRY_INTERVAL);
+	}
+}
+
+void ParseJournal::load()
+{
+	if (_loaded) {
+		return;
+	}
+	_loaded = true;
+
+	_operations.clear();
+	_resolved.clear();
+	_objects.clear();
+	_nextSequence = 1;
+	_inFlight = 0;
+	_deadRecords = 0;
+
+	QDir().mkpath(_directory);
+
+	// replay the journal in a single sequential pass
+	QFile file(filePath());
+	bool damaged = false;
+
+	if (file.open(QIODevice::ReadOnly)) {
+		QDataStream in(&file);
+		in.setVersion(QDataStream::Qt_4_6);
+
+		quint32 magic = 0;
+		in >> magic;
+		damaged = magic != PQ_JOURNAL_MAGIC;
+
+		QMap<quint32, Operation> operations;
+		int records = 0;
+
+		while (!damaged && !in.atEnd()) {
+			quint8 type = 0;
+			in >> type;
+
+			if (type == RecordOperation) {
+				Operation operation;
+				quint8 action = 0;
+				in >> operation.sequence >> action >> operation.className >> operation.objectId >> operation.localId >> operation.fields;
+				operation.action = Action(action);
+				if (in.status() == QDataStream::Ok) {
+					operations.insert(operation.sequence, operation);
+					_nextSequence = qMax(_nextSequence, operation.sequence + 1);
+				}
+			}
+			else if (type == RecordDone) {
+				quint32 sequence = 0;
+				in >> sequence;
+				operations.remove(sequence);
+			}
+			else if (type == RecordResolved) {
+				QString localId, objectId;
+				in >> localId >> objectId;
+				_resolved.insert(localId, objectId);
+			}
+			else {
+				damaged = true;
+			}
+
+			// a record cut off by a crash ends the journal
+			damaged |= in.status() != QDataStream::Ok;
+			++records;
+		}
+
+		_operations = operations.values();
+		_deadRecords = records - _operations.size();
+		file.close();
+	}
+
+	if (damaged || _deadRecords > qMax(_operations.size(), PQ_JOURNAL_MIN_DEAD_RECORDS)) {
+		compact();
+	}
+	else {
+		openFile();
+	}
+}
+
+bool ParseJournal::openFile()
+{
+	_file.close();
+	_file.setFileName(filePath());
+
+	bool exists = _file.exists();
+	if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		return false;
+	}
+
+	if (!exists) {
+		QDataStream out(&_file);
+		out.setVersion(QDataStream::Qt_4_6);
+		out << quint32(PQ_JOURNAL_MAGIC);
+		if (!flushRecord(out, 0)) {
+			_file.close();
+			_file.remove();
+			return false;
+		}
+	}
+	return true;
+}
+
+void ParseJournal::compact()
+{
+	_file.close();
+
+	QString path = filePath();
+	QString compactPath = path + ".compact";
+
+	QFile::remove(compactPath);
+	_file.setFileName(compactPath);
+	if (!_file.open(QIODevice::WriteOnly)) {
+		openFile();
+		return;
+	}
+
+	QDataStream out(&_file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << quint32(PQ_JOURNAL_MAGIC);
+
+	// only the local ids of queued operations are still needed
+	QHash<QString, QString> resolved;
+	foreach (const Operation &operation, _operations) {
+		if (!operation.localId.isEmpty() && _resolved.contains(operation.localId)) {
+			resolved.insert(operation.localId, _resolved.value(operation.localId));
+		}
+	}
+	_resolved = resolved;
+
+	bool written = flushRecord(out, 0);
+	for (QHash<QString, QString>::const_iterator i = _resolved.constBegin(); i != _resolved.constEnd(); ++i) {
+		written = written && writeResolved(i.key(), i.value());
+	}
+	foreach (const Operation &operation, _operations) {
+		written = written && writeOperation(operation);
+	}
+	_file.close();
+
+	// the journal is only replaced by a complete copy
+	if (!written) {
+		QFile::remove(compactPath);
+		openFile();
+		return;
+	}
+
+	QFile::remove(path);
+	QFile::rename(compactPath, path);
+	_deadRecords = 0;
+
+	openFile();
+}
+
+bool ParseJournal::writeOperation(const Operation &operation)
+{
+	qint64 start = _file.size();
+	QDataStream out(&_file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << quint8(RecordOperation) << operation.sequence << quint8(operation.action)
+		<< operation.className << operation.objectId << operation.localId << operation.fields;
+	return flushRecord(out, start);
+}
+
+bool ParseJournal::writeDone(quint32 sequence)
+{
+	qint64 start = _file.size();
+	QDataStream out(&_file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << quint8(RecordDone) << sequence;
+	return flushRecord(out, start);
+}
+
+bool ParseJournal::writeResolved(const QString &localId, const QString &objectId)
+{
+	qint64 start = _file.size();
+	QDataStream out(&_file);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << quint8(RecordResolved) << localId << objectId;
+	return flushRecord(out, start);
+}
+
+bool ParseJournal::flushRecord(const QDataStream &out, qint64 start)
+{
+	if (!_file.isOpen()) {
+		return false;
+	}
+	if (out.status() == QDataStream::Ok && _file.flush()) {
+		return true;
+	}
+
+	// a partial record would hide the ones appended after it when loading
+	_file.resize(start);
+	return false;
+}
+
+ParseError *ParseJournal::writeError() const
+{
+	QString reason = _file.isOpen() ? _file.errorString() : QString("journal file not open");
+	return new ParseError(ParseError::DomainParseQt, ParseError::ParseQtStorage, "can't write journal: " + reason);
+}
+
+QString ParseJournal::resolvedObjectId(const Operation &operation) const
+{
+	if (!operation.objectId.isEmpty() || operation.localId.isEmpty()) {
+		return operation.objectId;
+	}
+	return _resolved.value(operation.localId);
+}
+
+bool ParseJournal::isCreate(int index) const
+{
+	const Operation &operation = _operations.at(index);
+	if (operation.action != ActionSave || !resolvedObjectId(operation).isEmpty()) {
+		return false;
+	}
+	for (int i = 0; i < index; ++i) {
+		if (_operations.at(i).localId == operation.localId) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int ParseJournal::findPending(const QString &className, const QString &objectId, const QString &localId) const
+{
+	for (int i = _operations.size() - 1; i >= _inFlight; --i) {
+		const Operation &operation = _operations.at(i);
+		if (operation.className != className) {
+			continue;
+		}
+		if ((!localId.isEmpty() && operation.localId == localId)
+				|| (!objectId.isEmpty() && resolvedObjectId(operation) == objectId)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void ParseJournal::complete(const Operation &operation, const QVariantMap &json, ParseError *error)
+{
+	QPointer<ParseObject> object = _objects.take(operation.sequence);
+	if (object) {
+		object->completeEventually(operation.action == ActionErase, json, error);
+	}
+}
+
+QString ParseJournal::filePath() const
+{
+	return _directory + "/" + PQ_JOURNAL_FILE_NAME;
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,112 @@
+/*
+ * ParseJournal.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_JOURNAL_HPP_
+#define PARSEQT__PARSE_JOURNAL_HPP_
+
+#include <QtNetwork/QNetworkConfigurationManager>
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QTimer>
+#include <QVariant>
+
+namespace parseqt {
+
+class ParseObject;
+class ParseError;
+
+/// Internal class - durable queue of the writes of saveEventually and eraseEventually.
+/// Operations are appended to a journal file and sent in order via the batch endpoint whenever
+/// the device is online. A write to an object which is still queued is merged into the queued
+/// operation. Objects created while offline get a local id until the server assigned one.
+/// The journal file holds records which replace or complete earlier ones, it is rewritten when
+/// it holds more dead records than live ones.
+/// A batch without a usable reply, e.g. one which timed out, is sent again as a whole. The server
+/// may have applied it already, so its creates can then create the same objects twice.
+
+class ParseJournal : public QObject {
+	Q_OBJECT
+
+public:
+	enum Action {
+		ActionSave = 1,
+		ActionErase = 2
+	};
+
+	explicit ParseJournal(QObject *parent = 0);
+	virtual ~ParseJournal();
+
+	QString directory() const;
+	void setDirectory(const QString &directory);
+
+	/// queues an action on object with the json fields to save - takes over object's local id
+	/// returns an error, and queues nothing, if the action could not be written to the journal file
+	ParseError *enqueue(ParseObject *object, Action action, const QVariantMap &fields);
+	int pendingCount();
+
+	/// sends the queued operations soon, if online
+	void scheduleFlush();
+
+private:
+	Q_DISABLE_COPY(ParseJournal)
+
+	enum RecordType {
+		RecordOperation = 1, // a new operation, or the replacement of the one with the same sequence
+		RecordDone = 2, // the operation with the sequence was sent
+		RecordResolved = 3 // the server assigned an object id to a local id
+	};
+
+	struct Operation {
+		quint32 sequence;
+		Action action;
+		QString className;
+		QString objectId;
+		QString localId;
+		QVariantMap fields;
+	};
+
+	Q_SLOT void flush();
+	Q_SLOT void batchFinished();
+
+	void load();
+	bool openFile();
+	void compact();
+	bool writeOperation(const Operation &operation);
+	bool writeDone(quint32 sequence);
+	bool writeResolved(const QString &localId, const QString &objectId);
+	bool flushRecord(const QDataStream &out, qint64 start);
+	ParseError *writeError() const;
+
+	QString resolvedObjectId(const Operation &operation) const;
+	bool isCreate(int index) const; // the operation creates its object, no earlier one refers to it
+	int findPending(const QString &className, const QString &objectId, const QString &localId) const;
+	void complete(const Operation &operation, const QVariantMap &json, ParseError *error);
+
+	QString filePath() const;
+
+private:
+	QString _directory;
+	bool _loaded;
+	QFile _file;
+
+	QList<Operation> _operations; // in order, the first _inFlight ones are being sent
+	QHash<QString, QString> _resolved; // local id -> object id
+	QHash<quint32, QPointer<ParseObject> > _objects; // live objects by sequence
+	quint32 _nextSequence;
+	int _inFlight;
+	int _deadRecords;
+
+	QNetworkConfigurationManager _network;
+	QTimer _flushTimer;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_JOURNAL_HPP_ */
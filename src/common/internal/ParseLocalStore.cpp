@@ -0,0 +1,463 @@
+/*
+ * ParseLocalStore.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseLocalStore.hpp"
+
+#include "ParseManager.hpp"
+#include "ParseError.hpp"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+
+#define PQ_LOCAL_STORE_CONNECTION	"parseqt_local_store"
+#define PQ_LOCAL_STORE_FILE_NAME	"local.db"
+
+namespace parseqt {
+
+static const char *schema[] = {
+	"PRAGMA journal_mode = WAL",
+	"PRAGMA synchronous = NORMAL",
+	"CREATE TABLE IF NOT EXISTS objects (class TEXT NOT NULL, objectId TEXT NOT NULL, json BLOB NOT NULL, "
+		"PRIMARY KEY (class, objectId))",
+	"CREATE TABLE IF NOT EXISTS fields (class TEXT NOT NULL, objectId TEXT NOT NULL, key TEXT NOT NULL, num REAL, str TEXT)",
+	"CREATE INDEX IF NOT EXISTS fields_num ON fields (class, key, num)",
+	"CREATE INDEX IF NOT EXISTS fields_str ON fields (class, key, str)",
+	"CREATE INDEX IF NOT EXISTS fields_object ON fields (class, objectId)"
+};
+
+/// the indexed form of a constraint value, false if it can't be compared
+static bool comparableValue(const QVariant &value, QVariant *result)
+{
+	switch (value.type()) {
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Double:
+		*result = value.toDouble();
+		return true;
+	case QVariant::String:
+		*result = value.toString();
+		return true;
+	case QVariant::DateTime:
+		*result = double(value.toDateTime().toMSecsSinceEpoch());
+		return true;
+	default:
+		if (int(value.type()) == int(QMetaType::Float)) {
+			*result = value.toDouble();
+			return true;
+		}
+		return false;
+	}
+}
+
+/// the indexed form of a stored json value, false if it is not indexed
+static bool indexValue(const QString &key, const QVariant &json, QVariant *result)
+{
+	if (key == "createdAt" || key == "updatedAt") {
+		*result = double(ParseManager::dateTimeFromString(json.toString()).toMSecsSinceEpoch());
+		return true;
+	}
+
+	if (json.type() == QVariant::Map) {
+		QVariantMap map = json.toMap();
+		if (map.value("__type") != "Date") {
+			return false;
+		}
+		*result = double(ParseManager::dateTimeFromString(map.value("iso").toString()).toMSecsSinceEpoch());
+		return true;
+	}
+
+	return comparableValue(json, result);
+}
+
+static const char *sqlComparison(const QString &op)
+{
+	if (op == "$lt") {
+		return "<";
+	}
+	if (op == "$lte") {
+		return "<=";
+	}
+	if (op == "$gt") {
+		return ">";
+	}
+	if (op == "$gte") {
+		return ">=";
+	}
+	return NULL;
+}
+
+static QString column(const QVariant &value)
+{
+	return value.type() == QVariant::String ? "str" : "num";
+}
+
+ParseLocalStore::ParseLocalStore() : _opened(false) { }
+
+ParseLocalStore::~ParseLocalStore()
+{
+	close();
+	QSqlDatabase::removeDatabase(PQ_LOCAL_STORE_CONNECTION);
+}
+
+QString ParseLocalStore::directory() const
+{
+	return _directory;
+}
+
+void ParseLocalStore::setDirectory(const QString &directory)
+{
+	if (directory != _directory) {
+		close();
+		_directory = directory;
+	}
+}
+
+bool ParseLocalStore::insert(const QString &className, const QVariantList &jsonObjects, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	if (!open(error)) {
+		return false;
+	}
+
+	QSqlDatabase db = database();
+	db.transaction();
+
+	QSqlQuery insertObject(db);
+	QSqlQuery deleteFields(db);
+	QSqlQuery insertField(db);
+	insertObject.prepare("INSERT OR REPLACE INTO objects (class, objectId, json) VALUES (?, ?, ?)");
+	deleteFields.prepare("DELETE FROM fields WHERE class = ? AND objectId = ?");
+	insertField.prepare("INSERT INTO fields (class, objectId, key, num, str) VALUES (?, ?, ?, ?, ?)");
+
+	foreach (const QVariant &jsonObject, jsonObjects) {
+		QVariantMap json = jsonObject.toMap();
+		QString objectId = json.value("objectId").toString();
+		Q_ASSERT(!objectId.isEmpty());
+
+		insertObject.bindValue(0, className);
+		insertObject.bindValue(1, objectId);
+		insertObject.bindValue(2, encode(json));
+		deleteFields.bindValue(0, className);
+		deleteFields.bindValue(1, objectId);
+		if (!insertObject.exec() || !deleteFields.exec()) {
+			*error = queryError(insertObject.lastError().isValid() ? insertObject : deleteFields);
+			db.rollback();
+			return false;
+		}
+
+		for (QVariantMap::const_iterator i = json.constBegin(); i != json.constEnd(); ++i) {
+			QVariant value;
+			if (!indexValue(i.key(), i.value(), &value)) {
+				continue;
+			}
+
+			bool isString = value.type() == QVariant::String;
+			insertField.bindValue(0, className);
+			insertField.bindValue(1, objectId);
+			insertField.bindValue(2, i.key());
+			insertField.bindValue(3, isString ? QVariant(QVariant::Double) : value);
+			insertField.bindValue(4, isString ? value : QVariant(QVariant::String));
+			if (!insertField.exec()) {
+				*error = queryError(insertField);
+				db.rollback();
+				return false;
+			}
+		}
+	}
+
+	if (!db.commit()) {
+		*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtDatabase, db.lastError().text());
+		db.rollback();
+		return false;
+	}
+	return true;
+}
+
+bool ParseLocalStore::remove(const QString &className, const QStringList &objectIds, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	if (!open(error)) {
+		return false;
+	}
+
+	QSqlDatabase db = database();
+	db.transaction();
+
+	QSqlQuery deleteObject(db);
+	QSqlQuery deleteFields(db);
+	deleteObject.prepare("DELETE FROM objects WHERE class = ? AND objectId = ?");
+	deleteFields.prepare("DELETE FROM fields WHERE class = ? AND objectId = ?");
+
+	foreach (const QString &objectId, objectIds) {
+		deleteObject.bindValue(0, className);
+		deleteObject.bindValue(1, objectId);
+		deleteFields.bindValue(0, className);
+		deleteFields.bindValue(1, objectId);
+		if (!deleteObject.exec() || !deleteFields.exec()) {
+			*error = queryError(deleteObject.lastError().isValid() ? deleteObject : deleteFields);
+			db.rollback();
+			return false;
+		}
+	}
+
+	if (!db.commit()) {
+		*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtDatabase, db.lastError().text());
+		db.rollback();
+		return false;
+	}
+	return true;
+}
+
+QVariantList ParseLocalStore::find(const QString &className, const QVariantMap &where, const QVariantList &order,
+								   const QStringList &keys, int limit, int skip, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	if (!open(error)) {
+		return QVariantList();
+	}
+
+	QString joins;
+	QString conditions;
+	QVariantList joinBinds;
+	QVariantList conditionBinds;
+	if (!appendWhere(where, &joins, &joinBinds, &conditions, &conditionBinds, error)) {
+		return QVariantList();
+	}
+
+	// objects without the key are kept, like the server does
+	QString orderBy;
+	for (int i = 0; i < order.size(); ++i) {
+		QVariantMap entryMap = order.at(i).toMap();
+		QString table = QString("s%1").arg(i);
+		QString direction = entryMap.value("order").toInt() == Qt::DescendingOrder ? " DESC" : " ASC";
+
+		joins += " LEFT JOIN fields " + table + " ON " + table + ".class = o.class AND " + table + ".objectId = o.objectId AND "
+				+ table + ".key = ?";
+		joinBinds.append(entryMap.value("key"));
+		orderBy += (i ? ", " : " ORDER BY ") + table + ".num" + direction + ", " + table + ".str" + direction;
+	}
+
+	QVariantList binds = joinBinds;
+	binds.append(className);
+	binds += conditionBinds;
+	binds.append(limit);
+	binds.append(skip);
+
+	QSqlQuery query(database());
+	query.setForwardOnly(true);
+	if (!exec(&query, "SELECT o.json FROM objects o" + joins + " WHERE o.class = ?" + conditions + orderBy + " LIMIT ? OFFSET ?",
+			  binds, error)) {
+		return QVariantList();
+	}
+
+	QVariantList results;
+	while (query.next()) {
+		results.append(decode(query.value(0).toByteArray(), keys));
+	}
+	return results;
+}
+
+int ParseLocalStore::count(const QString &className, const QVariantMap &where, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	if (!open(error)) {
+		return -1;
+	}
+
+	QString joins;
+	QString conditions;
+	QVariantList binds;
+	QVariantList conditionBinds;
+	if (!appendWhere(where, &joins, &binds, &conditions, &conditionBinds, error)) {
+		return -1;
+	}
+	binds.append(className);
+	binds += conditionBinds;
+
+	QSqlQuery query(database());
+	query.setForwardOnly(true);
+	if (!exec(&query, "SELECT COUNT(*) FROM objects o" + joins + " WHERE o.class = ?" + conditions, binds, error)) {
+		return -1;
+	}
+
+	return query.next() ? query.value(0).toInt() : 0;
+}
+
+QVariantMap ParseLocalStore::get(const QString &className, const QString &objectId, const QStringList &keys, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	if (!open(error)) {
+		return QVariantMap();
+	}
+
+	QVariantList binds;
+	binds.append(className);
+	binds.append(objectId);
+
+	QSqlQuery query(database());
+	query.setForwardOnly(true);
+	if (!exec(&query, "SELECT json FROM objects WHERE class = ? AND objectId = ?", binds, error)) {
+		return QVariantMap();
+	}
+
+	return query.next() ? decode(query.value(0).toByteArray(), keys) : QVariantMap();
+}
+
+bool ParseLocalStore::open(ParseError **error)
+{
+	if (_opened) {
+		return true;
+	}
+
+	QDir().mkpath(_directory);
+
+	QSqlDatabase db = QSqlDatabase::contains(PQ_LOCAL_STORE_CONNECTION)
+			? database() : QSqlDatabase::addDatabase("QSQLITE", PQ_LOCAL_STORE_CONNECTION);
+	db.setDatabaseName(_directory + "/" + PQ_LOCAL_STORE_FILE_NAME);
+	if (!db.open()) {
+		*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtDatabase, db.lastError().text());
+		return false;
+	}
+
+	QSqlQuery query(db);
+	for (unsigned i = 0; i < sizeof(schema) / sizeof(schema[0]); ++i) {
+		if (!query.exec(schema[i])) {
+			*error = queryError(query);
+			db.close();
+			return false;
+		}
+	}
+
+	_opened = true;
+	return true;
+}
+
+void ParseLocalStore::close()
+{
+	if (QSqlDatabase::contains(PQ_LOCAL_STORE_CONNECTION)) {
+		database().close();
+	}
+	_opened = false;
+}
+
+QSqlDatabase ParseLocalStore::database() const
+{
+	return QSqlDatabase::database(PQ_LOCAL_STORE_CONNECTION, false);
+}
+
+bool ParseLocalStore::appendWhere(const QVariantMap &where, QString *joins, QVariantList *joinBinds,
+								  QString *conditions, QVariantList *conditionBinds, ParseError **error) const
+{
+	int tables = 0;
+
+	for (QVariantMap::const_iterator i = where.constBegin(); i != where.constEnd(); ++i) {
+		QVariantMap constraints = i.value().toMap();
+		QString table; // joined by the first comparison on the key
+
+		for (QVariantMap::const_iterator j = constraints.constBegin(); j != constraints.constEnd(); ++j) {
+			QVariant value;
+			if (!comparableValue(j.value(), &value)) {
+				*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType,
+										"unsupported value for local constraint on " + i.key());
+				return false;
+			}
+
+			// objects without the key are not equal to anything
+			if (j.key() == "$ne") {
+				conditions->append(" AND NOT EXISTS (SELECT 1 FROM fields n WHERE n.class = o.class AND n.objectId = o.objectId"
+								   " AND n.key = ? AND n." + column(value) + " = ?)");
+				conditionBinds->append(i.key());
+				conditionBinds->append(value);
+				continue;
+			}
+
+			const char *comparison = sqlComparison(j.key());
+			if (!comparison) {
+				*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType,
+										"unsupported local constraint " + j.key());
+				return false;
+			}
+
+			if (table.isEmpty()) {
+				table = QString("w%1").arg(tables++);
+				joins->append(" JOIN fields " + table + " ON " + table + ".class = o.class AND " + table + ".objectId = o.objectId AND "
+							  + table + ".key = ?");
+				joinBinds->append(i.key());
+			}
+			conditions->append(" AND " + table + "." + column(value) + " " + comparison + " ?");
+			conditionBinds->append(value);
+		}
+	}
+
+	return true;
+}
+
+bool ParseLocalStore::exec(QSqlQuery *query, const QString &sql, const QVariantList &binds, ParseError **error) const
+{
+	if (!query->prepare(sql)) {
+		*error = queryError(*query);
+		return false;
+	}
+	for (int i = 0; i < binds.size(); ++i) {
+		query->bindValue(i, binds.at(i));
+	}
+	if (!query->exec()) {
+		*error = queryError(*query);
+		return false;
+	}
+	return true;
+}
+
+QByteArray ParseLocalStore::encode(const QVariantMap &json)
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_6);
+	out << json;
+	return data;
+}
+
+QVariantMap ParseLocalStore::decode(const QByteArray &data, const QStringList &keys)
+{
+	QVariantMap json;
+	QDataStream in(data);
+	in.setVersion(QDataStream::Qt_4_6);
+	in >> json;
+
+	if (keys.isEmpty()) {
+		return json;
+	}
+
+	// the projection of ParseQuery::selectKeys
+	QVariantMap result;
+	foreach (const QString &key, QStringList() << "objectId" << "createdAt" << "updatedAt" << keys) {
+		QVariantMap::const_iterator i = json.constFind(key);
+		if (i != json.constEnd()) {
+			result.insert(key, i.value());
+		}
+	}
+	return result;
+}
+
+ParseError *ParseLocalStore::queryError(const QSqlQuery &query)
+{
+	return new ParseError(ParseError::DomainParseQt, ParseError::ParseQtDatabase, query.lastError().text());
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,68 @@
+/*
+ * ParseLocalStore.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_LOCAL_STORE_HPP_
+#define PARSEQT__PARSE_LOCAL_STORE_HPP_
+
+#include <QStringList>
+#include <QVariant>
+
+class QSqlDatabase;
+class QSqlQuery;
+
+namespace parseqt {
+
+class ParseError;
+
+/// Internal class - SQLite database of pinned objects, queried with the constraints of ParseQuery.
+/// Objects are stored as their json and every scalar top-level value is also kept in an indexed
+/// fields table - numbers and dates as numbers, strings as strings - so that comparisons and orderings
+/// are answered from the indexes without decoding objects.
+
+class ParseLocalStore {
+public:
+	ParseLocalStore();
+	~ParseLocalStore();
+
+	/// configuration
+	QString directory() const;
+	void setDirectory(const QString &directory);
+
+	/// storing objects as json maps, which have to hold an objectId - stored objects are replaced
+	bool insert(const QString &className, const QVariantList &jsonObjects, ParseError **error);
+	bool remove(const QString &className, const QStringList &objectIds, ParseError **error);
+
+	/// querying - where and order as built by ParseQuery, all keys are returned if keys is empty
+	QVariantList find(const QString &className, const QVariantMap &where, const QVariantList &order,
+					  const QStringList &keys, int limit, int skip, ParseError **error);
+	int count(const QString &className, const QVariantMap &where, ParseError **error);
+	QVariantMap get(const QString &className, const QString &objectId, const QStringList &keys, ParseError **error);
+
+private:
+	Q_DISABLE_COPY(ParseLocalStore)
+
+	bool open(ParseError **error);
+	void close();
+	QSqlDatabase database() const;
+
+	/// appends the joins and conditions of where to the sql fragments and their values to the binds
+	bool appendWhere(const QVariantMap &where, QString *joins, QVariantList *joinBinds,
+					 QString *conditions, QVariantList *conditionBinds, ParseError **error) const;
+	bool exec(QSqlQuery *query, const QString &sql, const QVariantList &binds, ParseError **error) const;
+
+	static QByteArray encode(const QVariantMap &json);
+	static QVariantMap decode(const QByteArray &data, const QStringList &keys);
+	static ParseError *queryError(const QSqlQuery &query);
+
+private:
+	QString _directory;
+	bool _opened;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_LOCAL_STORE_HPP_ */
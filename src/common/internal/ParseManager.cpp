@@ -7,23 +7,42 @@
 
 #include "ParseManager.hpp"
 
+#include "ParseCompression.hpp"
 #include "ParseError.hpp"
 #include "ParseJson.hpp"
+#include "ParseMetrics.hpp"
+#include "ParseObject.hpp"
 
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkReply>
 
 #include <QDateTime>
+#include <QDir>
 #include <QDebug>
 
+#include <limits>
+
+#define PQ_DEFAULT_SERVER_URL	"https://api.parse.com/1/"
+
+#define PQ_MIN_OBJECTS_PRUNE_SIZE	64
+
 #define PQ_DATETIME_FORMAT	"yyyy-MM-ddTHH:mm:ss.zzzZ"
+#define PQ_DATETIME_LENGTH	24
+
+#define PQ_REPLY_BODY_PROPERTY	"parseqt_body"
+#define PQ_REPLY_JSON_PROPERTY	"parseqt_json"
 
 namespace parseqt {
 
 Q_GLOBAL_STATIC(ParseManager, theParseManager);
 
-ParseManager::ParseManager() : _delegate(NULL), _trace(false)
+ParseManager::ParseManager() : _delegate(NULL), _compressionThreshold(0), _objectsPruneSize(PQ_MIN_OBJECTS_PRUNE_SIZE),
+	  _scheduler(&_accessManager)
 {
+	_scheduler.setMetrics(&_metrics);
+	_syncCache.setMaxSize(std::numeric_limits<qint64>::max());
+	setServerUrl(QUrl(PQ_DEFAULT_SERVER_URL));
+	setStorageDirectory(QDir::homePath() + "/parseqt");
 }
 
 ParseManager::~ParseManager()
@@ -67,17 +86,100 @@ void ParseManager::setApiKey(const QString &apiKey)
 	_apiKey = apiKey;
 }
 
-bool ParseManager::trace() const
+QUrl ParseManager::serverUrl() const
+{
+	return _serverUrl;
+}
+
+void ParseManager::setServerUrl(const QUrl &serverUrl)
+{
+	// relative urls are resolved against the server url, which therefore has to end with a slash
+	_serverUrl = serverUrl;
+	if (!_serverUrl.path().endsWith('/')) {
+		_serverUrl.setPath(_serverUrl.path() + '/');
+	}
+}
+
+QString ParseManager::storageDirectory() const
+{
+	return _storageDirectory;
+}
+
+void ParseManager::setStorageDirectory(const QString &storageDirectory)
+{
+	_storageDirectory = storageDirectory;
+	_cache.setDirectory(storageDirectory + "/cache");
+	_syncCache.setDirectory(storageDirectory + "/sync");
+	_journal.setDirectory(storageDirectory + "/journal");
+	_localStore.setDirectory(storageDirectory + "/local");
+}
+
+int ParseManager::compressionThreshold() const
+{
+	return _compressionThreshold;
+}
+
+void ParseManager::setCompressionThreshold(int compressionThreshold)
+{
+	_compressionThreshold = compressionThreshold;
+}
+
+ParseCache *ParseManager::cache()
+{
+	return &_cache;
+}
+
+ParseCache *ParseManager::syncCache()
+{
+	return &_syncCache;
+}
+
+ParseScheduler *ParseManager::scheduler()
+{
+	return &_scheduler;
+}
+
+ParseMetrics *ParseManager::metrics()
 {
-	return _trace;
+	return &_metrics;
 }
 
-void ParseManager::setTrace(bool trace)
+ParseJournal *ParseManager::journal()
 {
-	_trace = trace;
+	return &_journal;
 }
 
-ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QString &url, const QVariant &variant, QObject *receiver, const char *slot)
+ParseLocalStore *ParseManager::localStore()
+{
+	return &_localStore;
+}
+
+ParseObject *ParseManager::registeredObject(const QString &className, const QString &objectId) const
+{
+	return _objects.value(className + "/" + objectId);
+}
+
+void ParseManager::registerObject(ParseObject *object)
+{
+	Q_ASSERT(object);
+	Q_ASSERT(!object->objectId().isEmpty());
+
+	_objects.insert(object->className() + "/" + object->objectId(), object);
+
+	if (_objects.size() >= _objectsPruneSize) {
+		pruneObjects();
+	}
+}
+
+void ParseManager::unregisterObject(const QString &className, const QString &objectId, ParseObject *object)
+{
+	QHash<QString, QPointer<ParseObject> >::iterator i = _objects.find(className + "/" + objectId);
+	if (i != _objects.end() && i.value() == object) {
+		_objects.erase(i);
+	}
+}
+
+ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QString &url, const QVariant &variant, QObject *receiver, const char *slot, const char *progressSlot, ParseScheduler::Priority priority)
 {
 	Q_ASSERT(!url.isEmpty());
 	Q_ASSERT(receiver);
@@ -90,19 +192,19 @@ ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QSt
 
 	// Create NetworkRequest
 	QNetworkRequest request;
-	request.setUrl(QUrl("https://api.parse.com/1/" + url));
+	request.setUrl(_serverUrl.resolved(QUrl(url)));
 	request.setRawHeader(QString("X-Parse-Application-Id").toUtf8(), QString(_applicationId).toUtf8());
 	request.setRawHeader(QString("X-Parse-REST-API-Key").toUtf8(), QString(_apiKey).toUtf8());
 
-	// Dispatch according to method
-	QNetworkReply *reply = NULL;
+	// Setting the header ourselves turns off the built-in decompression, see readReply
+	request.setRawHeader("Accept-Encoding", "gzip, deflate");
+
+	// Prepare according to method
 	ParseError *error = NULL;
 	QByteArray buffer;
+	QByteArray key;
 
 	switch (op) {
-	case QNetworkAccessManager::HeadOperation:
-		break;
-
 	case QNetworkAccessManager::GetOperation:
 		if (!variant.isValid()) {
 			return new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInternal, "internal");
@@ -113,10 +215,15 @@ ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QSt
 			url.setEncodedQuery(buffer);
 			request.setUrl(url);
 		}
-		if (_trace) {
-			qDebug() << "get:" << buffer;
+		buffer.clear();
+
+		// share the reply of an identical get which is still queued or in flight
+		if (!progressSlot) {
+			key = request.url().toEncoded();
+			if (_scheduler.join(key, receiver, slot)) {
+				return NULL;
+			}
 		}
-		reply = _accessManager.get(request);
 		break;
 
 	case QNetworkAccessManager::PutOperation:
@@ -125,10 +232,7 @@ ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QSt
 			return error;
 		}
 		request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-		if (_trace) {
-			qDebug() << "put:" << buffer;
-		}
-		reply = _accessManager.put(request, buffer);
+		compressBody(&request, &buffer);
 		break;
 
 	case QNetworkAccessManager::PostOperation:
@@ -137,56 +241,72 @@ ParseError *ParseManager::request(QNetworkAccessManager::Operation op, const QSt
 			return error;
 		}
 		request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-		if (_trace) {
-			qDebug() << "post:" << buffer;
-		}
-		reply = _accessManager.post(request, buffer);
+		compressBody(&request, &buffer);
 		break;
 
 	case QNetworkAccessManager::DeleteOperation:
-		if (_trace) {
-			qDebug() << "delete";
-		}
-		reply = _accessManager.deleteResource(request);
-		break;
-
-	case QNetworkAccessManager::CustomOperation:
 		break;
 
 	default:
-		break;
+		return new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInternal, "unsupported operation");
 	}
 
-	Q_ASSERT(reply);
+	// Queue for sending
+	if (priority == ParseScheduler::PriorityAutomatic) {
+		priority = op == QNetworkAccessManager::GetOperation ? ParseScheduler::PriorityInteractive : ParseScheduler::PriorityNormal;
+	}
+
+	ParseScheduler::Receiver entry;
+	entry.object = receiver;
+	entry.slot = slot;
+	entry.progressSlot = progressSlot;
+
+	ParseScheduler::Request *scheduled = new ParseScheduler::Request;
+	scheduled->op = op;
+	scheduled->request = request;
+	scheduled->body = buffer;
+	scheduled->priority = priority;
+	scheduled->key = key;
+	scheduled->className = metricsClassName(url);
+	scheduled->receivers.append(entry);
 
-	// Connect for reply to finish
-	bool connected = QObject::connect(reply, SIGNAL(finished()), receiver, slot);
-	Q_ASSERT(connected);
-	Q_UNUSED(connected);
+	_scheduler.enqueue(scheduled);
 
 	return NULL;
 }
 
-QVariant ParseManager::retrieveJsonReply(QNetworkReply *reply, int expectedStatusCode, ParseError **error)
+QVariant ParseManager::retrieveJsonReply(QNetworkReply *reply, int expectedStatusCode, ParseError **error, QByteArray *body)
 {
 	Q_ASSERT(reply);
 	Q_ASSERT(error);
 
-	if (reply->error() != QNetworkReply::NoError) {
-		if (_trace) {
-			qDebug() << "reply: error" << reply;
-		}
-		*error = new ParseError(ParseError::DomainQNetwork, reply->error(), reply->errorString());
+	*error = replyError(reply);
+	if (*error) {
 		return QVariant();
 	}
 
-	QByteArray buffer = reply->readAll();
-	if (_trace) {
-		qDebug() << "reply:" << buffer;
-	}
-	QVariant json = ParseJson::read(buffer, error);
+	// replies shared by several receivers are read and decoded only once
+	QByteArray buffer = reply->property(PQ_REPLY_BODY_PROPERTY).toByteArray();
+	QVariant json = reply->property(PQ_REPLY_JSON_PROPERTY);
 	if (!json.isValid()) {
-		return QVariant();
+		if (buffer.isEmpty()) {
+			buffer = readReply(reply, error);
+			if (*error) {
+				return QVariant();
+			}
+			reply->setProperty(PQ_REPLY_BODY_PROPERTY, buffer);
+		}
+		QElapsedTimer timer;
+		timer.start();
+		json = ParseJson::read(buffer, error);
+		ParseRequestMetrics::addDecodeTime(reply, timer);
+		if (!json.isValid()) {
+			return QVariant();
+		}
+		reply->setProperty(PQ_REPLY_JSON_PROPERTY, json);
+	}
+	if (body) {
+		*body = buffer;
 	}
 
 	if (expectedStatusCode != -1 && (expectedStatusCode != reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())) {
@@ -198,8 +318,132 @@ QVariant ParseManager::retrieveJsonReply(QNetworkReply *reply, int expectedStatu
 	return json;
 }
 
+void ParseManager::pruneObjects()
+{
+	QHash<QString, QPointer<ParseObject> >::iterator i = _objects.begin();
+	while (i != _objects.end()) {
+		if (i.value().isNull()) {
+			i = _objects.erase(i);
+		}
+		else {
+			++i;
+		}
+	}
+
+	// twice the live entries keeps pruning amortized constant per registration
+	_objectsPruneSize = qMax(2 * _objects.size(), PQ_MIN_OBJECTS_PRUNE_SIZE);
+}
+
+QString ParseManager::metricsClassName(const QString &url)
+{
+	// "classes/Item/id" is measured as "Item", other endpoints like "batch" by their name
+	QString path = url.section('?', 0, 0);
+	if (path.startsWith("classes/")) {
+		return path.section('/', 1, 1);
+	}
+	return path.section('/', 0, 0);
+}
+
+QByteArray ParseManager::readReply(QNetworkReply *reply, ParseError **error)
+{
+	Q_ASSERT(reply);
+	Q_ASSERT(error);
+
+	QByteArray data = reply->readAll();
+	if (!isEncoded(reply)) {
+		return data;
+	}
+
+	// inflate chunk by chunk with the inflater owned by the reply
+	ParseInflater *inflater = reply->findChild<ParseInflater *>();
+	if (!inflater) {
+		inflater = new ParseInflater(reply);
+	}
+
+	QByteArray result;
+	if (!inflater->inflate(data, &result)) {
+		*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidEncoding, "invalid content encoding");
+		return QByteArray();
+	}
+	return result;
+}
+
+bool ParseManager::isEncoded(QNetworkReply *reply)
+{
+	QByteArray encoding = reply->rawHeader("Content-Encoding").trimmed().toLower();
+	return encoding == "gzip" || encoding == "deflate" || encoding == "x-gzip";
+}
+
+void ParseManager::compressBody(QNetworkRequest *request, QByteArray *buffer) const
+{
+	if (!_compressionThreshold || buffer->size() < _compressionThreshold) {
+		return;
+	}
+
+	QByteArray compressed = gzipCompress(*buffer);
+	if (!compressed.isEmpty() && compressed.size() < buffer->size()) {
+		*buffer = compressed;
+		request->setRawHeader("Content-Encoding", "gzip");
+	}
+}
+
+ParseError *ParseManager::replyError(QNetworkReply *reply)
+{
+	Q_ASSERT(reply);
+
+	if (ParseScheduler::timedOut(reply)) {
+		return new ParseError(ParseError::DomainQNetwork, QNetworkReply::TimeoutError, "request timed out");
+	}
+	if (reply->error() != QNetworkReply::NoError) {
+		return new ParseError(ParseError::DomainQNetwork, reply->error(), reply->errorString());
+	}
+	return NULL;
+}
+
+static inline int parseDigits(const QChar *digits, int count)
+{
+	int result = 0;
+	for (int i = 0; i < count; ++i) {
+		ushort digit = digits[i].unicode() - '0';
+		if (digit > 9) {
+			return -1;
+		}
+		result = result * 10 + digit;
+	}
+	return result;
+}
+
+static inline void writeDigits(QChar *digits, int count, int value)
+{
+	for (int i = count - 1; i >= 0; --i) {
+		digits[i] = QChar('0' + value % 10);
+		value /= 10;
+	}
+}
+
 QDateTime ParseManager::dateTimeFromString(const QString &string)
 {
+	// parse's dates always have the fixed layout of PQ_DATETIME_FORMAT, so parse it directly
+	if (string.size() == PQ_DATETIME_LENGTH) {
+		const QChar *chars = string.constData();
+		if (chars[4] == '-' && chars[7] == '-' && chars[10] == 'T' && chars[13] == ':'
+				&& chars[16] == ':' && chars[19] == '.' && chars[23] == 'Z') {
+			int year = parseDigits(chars, 4);
+			int month = parseDigits(chars + 5, 2);
+			int day = parseDigits(chars + 8, 2);
+			int hour = parseDigits(chars + 11, 2);
+			int minute = parseDigits(chars + 14, 2);
+			int second = parseDigits(chars + 17, 2);
+			int msec = parseDigits(chars + 20, 3);
+
+			QDate date(year, month, day);
+			QTime time(hour, minute, second, msec);
+			if (date.isValid() && time.isValid()) {
+				return QDateTime(date, time, Qt::UTC);
+			}
+		}
+	}
+
 	QDateTime dateTime(QDateTime::fromString(string, PQ_DATETIME_FORMAT));
 	dateTime.setTimeSpec(Qt::UTC);
 	return dateTime;
@@ -208,113 +452,247 @@ QDateTime ParseManager::dateTimeFromString(const QString &string)
 QString ParseManager::stringFromDateTime(const QDateTime &dateTime)
 {
 	QDateTime utcDateTime(dateTime.toUTC());
-	return utcDateTime.toString(PQ_DATETIME_FORMAT);
+	QDate date = utcDateTime.date();
+	QTime time = utcDateTime.time();
+
+	if (!utcDateTime.isValid() || date.year() < 0 || date.year() > 9999) {
+		return utcDateTime.toString(PQ_DATETIME_FORMAT);
+	}
+
+	QString result(PQ_DATETIME_LENGTH, Qt::Uninitialized);
+	QChar *chars = result.data();
+
+	writeDigits(chars, 4, date.year());
+	chars[4] = '-';
+	writeDigits(chars + 5, 2, date.month());
+	chars[7] = '-';
+	writeDigits(chars + 8, 2, date.day());
+	chars[10] = 'T';
+	writeDigits(chars + 11, 2, time.hour());
+	chars[13] = ':';
+	writeDigits(chars + 14, 2, time.minute());
+	chars[16] = ':';
+	writeDigits(chars + 17, 2, time.second());
+	chars[19] = '.';
+	writeDigits(chars + 20, 3, time.msec());
+	chars[23] = 'Z';
+
+	return result;
+}
+
+QString ParseManager::batchPath(const QString &url) const
+{
+	return _serverUrl.path() + url;
+}
+
+static bool isPlainJson(QVariant::Type type)
+{
+	switch (type) {
+	case QVariant::Invalid:
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Double:
+	case QVariant::String:
+		return true;
+	default:
+		return false;
+	}
 }
 
 QVariant ParseManager::jsonify(const QVariant &data, ParseError **error)
 {
 	Q_ASSERT(error);
 
+	QVariant result;
+	bool changed = false;
+	if (!jsonifyValue(data, &result, &changed, error)) {
+		return QVariant();
+	}
+
+	return changed ? result : data;
+}
+
+QVariant ParseManager::objectify(const QVariant &json, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	QVariant result;
+	bool changed = false;
+	if (!objectifyValue(json, &result, &changed, error)) {
+		return QVariant();
+	}
+
+	return changed ? result : json;
+}
+
+bool ParseManager::jsonifyValue(const QVariant &data, QVariant *result, bool *changed, ParseError **error)
+{
 	QVariant::Type dataType = data.type();
 
+	if (isPlainJson(dataType)) {
+		return true;
+	}
 	if (dataType == QVariant::DateTime) {
-		QVariantMap result;
-		result.insert("__type", "Date");
-		result.insert("iso", stringFromDateTime(data.toDateTime()));
-		return result;
+		QVariantMap map;
+		map.insert("__type", "Date");
+		map.insert("iso", stringFromDateTime(data.toDateTime()));
+		*result = map;
+		*changed = true;
+		return true;
 	}
 	if (dataType == QVariant::ByteArray) {
-		QVariantMap result;
-		result.insert("__type", "Bytes");
-		result.insert("base64", data.toByteArray().toBase64());
-		return result;
+		QVariantMap map;
+		map.insert("__type", "Bytes");
+		map.insert("base64", data.toByteArray().toBase64());
+		*result = map;
+		*changed = true;
+		return true;
 	}
+
+	// containers are walked without copying, a copy is made only when the first value changes
 	if (dataType == QVariant::List) {
-		QVariantList result;
-		foreach (const QVariant &variant, data.toList()) {
-			QVariant json = jsonify(variant, error);
-			if (!json.isValid()) {
-				return json;
+		const QVariantList &list = *static_cast<const QVariantList *>(data.constData());
+		QVariantList converted;
+		for (int i = 0; i < list.size(); ++i) {
+			QVariant json;
+			bool jsonChanged = false;
+			if (!jsonifyValue(list.at(i), &json, &jsonChanged, error)) {
+				return false;
+			}
+			if (jsonChanged) {
+				if (!*changed) {
+					converted = list;
+					*changed = true;
+				}
+				converted[i] = json;
 			}
-			result.append(json);
 		}
-		return result;
+		if (*changed) {
+			*result = converted;
+		}
+		return true;
 	}
 	if (dataType == QVariant::Map) {
-		QVariantMap result;
-		QVariantMap map = data.toMap();
-		foreach (const QString &key, map.keys()) {
-			QVariant json = jsonify(map.value(key), error);
-			if (!json.isValid()) {
-				return json;
+		const QVariantMap &map = *static_cast<const QVariantMap *>(data.constData());
+		QVariantMap converted;
+		for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i) {
+			QVariant json;
+			bool jsonChanged = false;
+			if (!jsonifyValue(i.value(), &json, &jsonChanged, error)) {
+				return false;
+			}
+			if (jsonChanged) {
+				if (!*changed) {
+					converted = map;
+					*changed = true;
+				}
+				converted.insert(i.key(), json);
 			}
-			result.insert(key, json);
 		}
-		return result;
+		if (*changed) {
+			*result = converted;
+		}
+		return true;
 	}
 
 	if (_delegate) {
-		QVariant result = _delegate->jsonify(data, error);
-		if (result.isValid()) {
-			return result;
+		QVariant json = _delegate->jsonify(data, error);
+		if (*error) {
+			return false;
+		}
+		if (json.isValid()) {
+			*result = json;
+			*changed = true;
 		}
 	}
 
-	return data;
+	return true;
 }
 
-QVariant ParseManager::objectify(const QVariant &json, ParseError **error)
+bool ParseManager::objectifyValue(const QVariant &json, QVariant *result, bool *changed, ParseError **error)
 {
-	Q_ASSERT(error);
-
 	QVariant::Type dataType = json.type();
 
 	if (dataType == QVariant::List) {
-		QVariantList result;
-		foreach (const QVariant &variant, json.toList()) {
-			QVariant object = objectify(variant, error);
-			if (!object.isValid()) {
-				return object;
+		const QVariantList &list = *static_cast<const QVariantList *>(json.constData());
+		QVariantList converted;
+		for (int i = 0; i < list.size(); ++i) {
+			QVariant object;
+			bool objectChanged = false;
+			if (!objectifyValue(list.at(i), &object, &objectChanged, error)) {
+				return false;
 			}
-			result.append(object);
+			if (objectChanged) {
+				if (!*changed) {
+					converted = list;
+					*changed = true;
+				}
+				converted[i] = object;
+			}
+		}
+		if (*changed) {
+			*result = converted;
 		}
-		return result;
+		return true;
 	}
 
 	if (dataType != QVariant::Map) {
-		return json;
+		return true;
 	}
 
-	QVariantMap map = json.toMap();
-	if (!map.contains("__type")) {
-		QVariantMap result;
-		foreach (const QString &key, map.keys()) {
-			QVariant object = objectify(map.value(key), error);
-			if (!object.isValid()) {
-				return object;
+	const QVariantMap &map = *static_cast<const QVariantMap *>(json.constData());
+	QVariantMap::const_iterator typeIterator = map.constFind("__type");
+	if (typeIterator == map.constEnd()) {
+		QVariantMap converted;
+		for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i) {
+			QVariant object;
+			bool objectChanged = false;
+			if (!objectifyValue(i.value(), &object, &objectChanged, error)) {
+				return false;
+			}
+			if (objectChanged) {
+				if (!*changed) {
+					converted = map;
+					*changed = true;
+				}
+				converted.insert(i.key(), object);
 			}
-			result.insert(key, object);
 		}
-		return result;
+		if (*changed) {
+			*result = converted;
+		}
+		return true;
 	}
 
-	QString type = map.value("__type").toString();
+	QString type = typeIterator.value().toString();
 	if (type == "Date") {
-		return dateTimeFromString(map.value("iso").toString());
+		*result = dateTimeFromString(map.value("iso").toString());
+		*changed = true;
+		return true;
 	}
 	if (type == "Bytes") {
-		return QByteArray::fromBase64(map.value("base64").toByteArray());
+		*result = QByteArray::fromBase64(map.value("base64").toByteArray());
+		*changed = true;
+		return true;
 	}
 
 	if (_delegate) {
-		QVariant result = _delegate->objectify(json, error);
-		if (result.isValid()) {
-			return result;
+		QVariant object = _delegate->objectify(json, error);
+		if (object.isValid()) {
+			*result = object;
+			*changed = true;
+			return true;
+		}
+		if (*error) {
+			return false;
 		}
 	}
 
 	*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType, "invalid type: " + type);
-	return QVariant();
+	return false;
 }
 
 void ParseManager::debugJson(const QString &message, const QVariant &json)
@@ -8,12 +8,22 @@
 #ifndef PARSEQT__PARSE_MANAGER_HPP_
 #define PARSEQT__PARSE_MANAGER_HPP_
 
+#include "ParseCache.hpp"
+#include "ParseJournal.hpp"
+#include "ParseLocalStore.hpp"
+#include "ParseMetrics.hpp"
+#include "ParseScheduler.hpp"
+
 #include <QtNetwork/QNetworkAccessManager>
+#include <QHash>
+#include <QPointer>
+#include <QUrl>
 #include <QVariant>
 
 namespace parseqt {
 
 class ParseError;
+class ParseObject;
 
 /// Internal class - use class Parse instead
 
@@ -35,13 +45,47 @@ public:
 	void setApplicationId(const QString &applicationId);
 	QString apiKey() const;
 	void setApiKey(const QString &apiKey);
-	bool trace() const;
-	void setTrace(bool trace);
-
-	/// communication
+	QUrl serverUrl() const;
+	void setServerUrl(const QUrl &serverUrl);
+	QString storageDirectory() const;
+	void setStorageDirectory(const QString &storageDirectory);
+	int compressionThreshold() const; // request bodies of at least this size are sent gzip compressed, 0 disables
+	void setCompressionThreshold(int compressionThreshold);
+
+	/// caching of query results
+	ParseCache *cache();
+
+	/// results of sync queries - not bounded in size, as a dropped entry means fetching all objects again
+	ParseCache *syncCache();
+
+	/// queueing, concurrency and rate limits of requests
+	ParseScheduler *scheduler();
+	ParseMetrics *metrics();
+
+	/// writes of saveEventually and eraseEventually
+	ParseJournal *journal();
+
+	/// pinned objects
+	ParseLocalStore *localStore();
+
+	/// identity map of the live objects with an objectId, so that each server object is loaded
+	/// into a single ParseObject - entries are weak and dropped once their object is deleted
+	ParseObject *registeredObject(const QString &className, const QString &objectId) const;
+	void registerObject(ParseObject *object);
+	void unregisterObject(const QString &className, const QString &objectId, ParseObject *object);
+
+	/// communication - progressSlot (optional) is connected to the readyRead signal of the reply
+	/// gets without progressSlot join an identical get still queued or in flight and share its reply
+	/// requests are sent by priority, gets default to interactive and all others to normal
 	ParseError *request(QNetworkAccessManager::Operation op, const QString &url, const QVariant& variant,
-						QObject *receiver, const char *slot);
-	QVariant retrieveJsonReply(QNetworkReply *reply, int expectedStatusCode, ParseError **error);
+						QObject *receiver, const char *slot, const char *progressSlot = 0,
+						ParseScheduler::Priority priority = ParseScheduler::PriorityAutomatic);
+	QVariant retrieveJsonReply(QNetworkReply *reply, int expectedStatusCode, ParseError **error, QByteArray *body = 0);
+	static ParseError *replyError(QNetworkReply *reply);
+
+	/// reads what is available of the body of reply, decompressing it if needed
+	static QByteArray readReply(QNetworkReply *reply, ParseError **error);
+	static bool isEncoded(QNetworkReply *reply);
 
 	/// ifyers
 	QVariant jsonify(const QVariant &data, ParseError **error);
@@ -50,14 +94,34 @@ public:
 	/// helpers
 	static QDateTime dateTimeFromString(const QString &string);
 	static QString stringFromDateTime(const QDateTime &dateTime);
+	QString batchPath(const QString &url) const; // the path of url on the server, as used by batch requests
 	static void debugJson(const QString &message, const QVariant &json);
 
+private:
+	/// convert in a single traversal, result is only written and changed only set if data differs from its conversion
+	bool jsonifyValue(const QVariant &data, QVariant *result, bool *changed, ParseError **error);
+	bool objectifyValue(const QVariant &json, QVariant *result, bool *changed, ParseError **error);
+
+	void compressBody(QNetworkRequest *request, QByteArray *buffer) const;
+	void pruneObjects();
+	static QString metricsClassName(const QString &url);
+
 private:
 	ParseManagerDelegate *_delegate;
 	QString _applicationId;
 	QString _apiKey;
-	bool _trace;
+	QUrl _serverUrl;
+	QString _storageDirectory;
+	int _compressionThreshold;
+	ParseCache _cache;
+	ParseCache _syncCache;
+	ParseLocalStore _localStore;
+	QHash<QString, QPointer<ParseObject> > _objects; // by class name and objectId
+	int _objectsPruneSize; // number of entries at which deleted objects are dropped
+	ParseMetrics _metrics; // outlives the replies whose metrics are recorded on deletion
 	QNetworkAccessManager _accessManager;
+	ParseScheduler _scheduler;
+	ParseJournal _journal;
 };
 
 class ParseManagerDelegate {
@@ -0,0 +1,252 @@
+/*
+ * ParseMetrics.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseMetrics.hpp"
+
+namespace parseqt {
+
+/// upper bounds of the histogram buckets, a last bucket takes everything above
+static const double timeBounds[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000 };
+static const double byteBounds[] = { 256, 1024, 4096, 16384, 65536, 262144, 1048576, 4194304 };
+
+static const char *metricNames[] = {
+	"queueTime", "firstByteTime", "transferTime", "requestBytes", "responseBytes", "decodeTime", "objectifyTime"
+};
+
+static bool isByteMetric(ParseMetrics::Metric metric)
+{
+	return metric == ParseMetrics::MetricRequestBytes || metric == ParseMetrics::MetricResponseBytes;
+}
+
+static int boundCount(ParseMetrics::Metric metric)
+{
+	return isByteMetric(metric) ? int(sizeof(byteBounds) / sizeof(double)) : int(sizeof(timeBounds) / sizeof(double));
+}
+
+static double bound(ParseMetrics::Metric metric, int index)
+{
+	return isByteMetric(metric) ? byteBounds[index] : timeBounds[index];
+}
+
+static QString operationName(QNetworkAccessManager::Operation op)
+{
+	switch (op) {
+	case QNetworkAccessManager::GetOperation:
+		return "GET";
+	case QNetworkAccessManager::PutOperation:
+		return "PUT";
+	case QNetworkAccessManager::PostOperation:
+		return "POST";
+	case QNetworkAccessManager::DeleteOperation:
+		return "DELETE";
+	default:
+		return "OTHER";
+	}
+}
+
+static double elapsedMs(const QElapsedTimer &timer)
+{
+	return timer.nsecsElapsed() / 1000000.0;
+}
+
+///
+
+ParseMetrics::Sample::Sample() : status(0), failed(false)
+{
+	for (int i = 0; i < MetricCount; ++i) {
+		values[i] = -1;
+	}
+}
+
+ParseMetrics::Histogram::Histogram() : count(0), sum(0), min(0), max(0) { }
+
+ParseMetrics::Entry::Entry() : requests(0), failures(0) { }
+
+ParseMetrics::ParseMetrics(QObject *parent) : QObject(parent) { }
+
+ParseMetrics::~ParseMetrics() { }
+
+void ParseMetrics::record(const Sample &sample)
+{
+	Entry &entry = _entries[sample.operation + " " + sample.className];
+
+	++entry.requests;
+	if (sample.failed) {
+		++entry.failures;
+	}
+	for (int i = 0; i < MetricCount; ++i) {
+		if (sample.values[i] >= 0) {
+			add(&entry.histograms[i], Metric(i), sample.values[i]);
+		}
+	}
+
+	// building the map is only worth it if somebody listens
+	if (receivers(SIGNAL(requestMeasured(const QVariantMap &))) > 0) {
+		Q_EMIT requestMeasured(toVariant(sample));
+	}
+}
+
+void ParseMetrics::reset()
+{
+	_entries.clear();
+}
+
+QVariantMap ParseMetrics::toVariant() const
+{
+	QVariantMap result;
+
+	for (QHash<QString, Entry>::const_iterator i = _entries.constBegin(); i != _entries.constEnd(); ++i) {
+		const Entry &entry = i.value();
+
+		QVariantMap entryMap;
+		entryMap.insert("requests", entry.requests);
+		entryMap.insert("failures", entry.failures);
+		for (int j = 0; j < MetricCount; ++j) {
+			entryMap.insert(metricNames[j], toVariant(entry.histograms[j], Metric(j)));
+		}
+
+		result.insert(i.key(), entryMap);
+	}
+
+	return result;
+}
+
+QVariantMap ParseMetrics::toVariant(const Sample &sample)
+{
+	QVariantMap result;
+	result.insert("operation", sample.operation);
+	result.insert("className", sample.className);
+	result.insert("status", sample.status);
+	result.insert("failed", sample.failed);
+	for (int i = 0; i < MetricCount; ++i) {
+		if (sample.values[i] >= 0) {
+			result.insert(metricNames[i], sample.values[i]);
+		}
+	}
+	return result;
+}
+
+void ParseMetrics::add(Histogram *histogram, Metric metric, double value)
+{
+	if (histogram->buckets.isEmpty()) {
+		histogram->buckets.fill(0, boundCount(metric) + 1);
+		histogram->min = value;
+		histogram->max = value;
+	}
+
+	++histogram->count;
+	histogram->sum += value;
+	histogram->min = qMin(histogram->min, value);
+	histogram->max = qMax(histogram->max, value);
+
+	int bucket = 0;
+	while (bucket < boundCount(metric) && value > bound(metric, bucket)) {
+		++bucket;
+	}
+	++histogram->buckets[bucket];
+}
+
+QVariantMap ParseMetrics::toVariant(const Histogram &histogram, Metric metric)
+{
+	QVariantMap result;
+	result.insert("count", histogram.count);
+	if (!histogram.count) {
+		return result;
+	}
+
+	result.insert("sum", histogram.sum);
+	result.insert("min", histogram.min);
+	result.insert("max", histogram.max);
+	result.insert("mean", histogram.sum / histogram.count);
+
+	// buckets as {le: upper bound, count: n}, the last one without bound
+	QVariantList buckets;
+	for (int i = 0; i < histogram.buckets.size(); ++i) {
+		QVariantMap bucket;
+		if (i < boundCount(metric)) {
+			bucket.insert("le", bound(metric, i));
+		}
+		bucket.insert("count", histogram.buckets.at(i));
+		buckets.append(bucket);
+	}
+	result.insert("buckets", buckets);
+
+	return result;
+}
+
+///
+
+ParseRequestMetrics::ParseRequestMetrics(QNetworkReply *reply, ParseMetrics *metrics, const QString &className,
+										 double queueTime, qint64 requestBytes)
+	: QObject(reply), _metrics(metrics)
+{
+	Q_ASSERT(reply);
+	Q_ASSERT(metrics);
+
+	_sent.start();
+
+	_sample.operation = operationName(reply->operation());
+	_sample.className = className;
+	_sample.values[ParseMetrics::MetricQueueTime] = queueTime;
+	_sample.values[ParseMetrics::MetricRequestBytes] = requestBytes;
+
+	connect(reply, SIGNAL(metaDataChanged()), this, SLOT(metaDataChanged()));
+	connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(downloadProgress(qint64, qint64)));
+	connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+}
+
+ParseRequestMetrics::~ParseRequestMetrics()
+{
+	_metrics->record(_sample);
+}
+
+void ParseRequestMetrics::addDecodeTime(QNetworkReply *reply, const QElapsedTimer &timer)
+{
+	addTime(reply, ParseMetrics::MetricDecodeTime, timer);
+}
+
+void ParseRequestMetrics::addObjectifyTime(QNetworkReply *reply, const QElapsedTimer &timer)
+{
+	addTime(reply, ParseMetrics::MetricObjectifyTime, timer);
+}
+
+void ParseRequestMetrics::addTime(QNetworkReply *reply, ParseMetrics::Metric metric, const QElapsedTimer &timer)
+{
+	ParseRequestMetrics *requestMetrics = reply ? reply->findChild<ParseRequestMetrics *>() : NULL;
+	if (!requestMetrics) {
+		return;
+	}
+
+	double &value = requestMetrics->_sample.values[metric];
+	value = qMax(value, 0.0) + elapsedMs(timer);
+}
+
+void ParseRequestMetrics::metaDataChanged()
+{
+	double &value = _sample.values[ParseMetrics::MetricFirstByteTime];
+	if (value < 0) {
+		value = elapsedMs(_sent);
+	}
+}
+
+void ParseRequestMetrics::downloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+	Q_UNUSED(bytesTotal);
+
+	_sample.values[ParseMetrics::MetricResponseBytes] = bytesReceived;
+}
+
+void ParseRequestMetrics::finished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(parent());
+
+	_sample.values[ParseMetrics::MetricTransferTime] = elapsedMs(_sent);
+	_sample.status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	_sample.failed = reply->error() != QNetworkReply::NoError;
+}
+
+} /* namespace parseqt */
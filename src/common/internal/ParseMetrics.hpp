@@ -0,0 +1,120 @@
+/*
+ * ParseMetrics.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_METRICS_HPP_
+#define PARSEQT__PARSE_METRICS_HPP_
+
+#include <QtNetwork/QNetworkReply>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVariant>
+#include <QVector>
+
+namespace parseqt {
+
+/// Internal class - aggregates timing and size measurements of requests into histograms,
+/// keyed by operation and class (e.g. "GET Item" or "POST batch").
+
+class ParseMetrics : public QObject {
+	Q_OBJECT
+
+public:
+	enum Metric {
+		MetricQueueTime = 0, // ms from enqueuing to sending
+		MetricFirstByteTime, // ms from sending to the reply headers
+		MetricTransferTime, // ms from sending to the end of the reply
+		MetricRequestBytes,
+		MetricResponseBytes, // as transferred, i.e. before decompression
+		MetricDecodeTime, // ms spent reading json
+		MetricObjectifyTime, // ms spent creating objects from json
+		MetricCount
+	};
+
+	struct Sample {
+		Sample();
+
+		QString operation;
+		QString className;
+		int status; // http status, 0 if the request failed before
+		bool failed;
+		double values[MetricCount]; // negative values were not measured
+	};
+
+	explicit ParseMetrics(QObject *parent = 0);
+	virtual ~ParseMetrics();
+
+	void record(const Sample &sample);
+	void reset();
+
+	/// the histograms of all keys, see Parse::metrics for the layout
+	QVariantMap toVariant() const;
+	static QVariantMap toVariant(const Sample &sample);
+
+	/// emitted for every request when connected
+	Q_SIGNAL void requestMeasured(const QVariantMap &sample);
+
+private:
+	Q_DISABLE_COPY(ParseMetrics)
+
+	struct Histogram {
+		Histogram();
+
+		int count;
+		double sum;
+		double min;
+		double max;
+		QVector<int> buckets;
+	};
+
+	struct Entry {
+		Entry();
+
+		int requests;
+		int failures;
+		Histogram histograms[MetricCount];
+	};
+
+	static void add(Histogram *histogram, Metric metric, double value);
+	static QVariantMap toVariant(const Histogram &histogram, Metric metric);
+
+private:
+	QHash<QString, Entry> _entries;
+};
+
+/// Internal class - measures one reply, as its child. The sample is recorded when the reply is
+/// deleted, so that receivers can still add the time they spend decoding it.
+
+class ParseRequestMetrics : public QObject {
+	Q_OBJECT
+
+public:
+	ParseRequestMetrics(QNetworkReply *reply, ParseMetrics *metrics, const QString &className,
+						double queueTime, qint64 requestBytes);
+	virtual ~ParseRequestMetrics();
+
+	/// add time measured with an QElapsedTimer to the metrics of reply, if measured
+	static void addDecodeTime(QNetworkReply *reply, const QElapsedTimer &timer);
+	static void addObjectifyTime(QNetworkReply *reply, const QElapsedTimer &timer);
+
+private:
+	Q_DISABLE_COPY(ParseRequestMetrics)
+
+	Q_SLOT void metaDataChanged();
+	Q_SLOT void downloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+	Q_SLOT void finished();
+
+	static void addTime(QNetworkReply *reply, ParseMetrics::Metric metric, const QElapsedTimer &timer);
+
+private:
+	ParseMetrics *_metrics;
+	ParseMetrics::Sample _sample;
+	QElapsedTimer _sent;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_METRICS_HPP_ */
@@ -0,0 +1,329 @@
+/*
+ * ParseQueryEvaluator.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseQueryEvaluator.hpp"
+
+#include "ParseManager.hpp"
+#include "ParseObject.hpp"
+#include "ParseError.hpp"
+
+#include <QtAlgorithms>
+
+namespace parseqt {
+
+typedef ParseQueryEvaluator::Value Value;
+
+static int compareValues(const Value &a, const Value &b)
+{
+	if (a.kind != b.kind) {
+		return a.kind < b.kind ? -1 : 1;
+	}
+
+	switch (a.kind) {
+	case Value::KindNumber:
+	case Value::KindDate:
+		return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+	case Value::KindString:
+		return a.string.compare(b.string);
+	default:
+		return 0;
+	}
+}
+
+static bool isComparable(const Value &value)
+{
+	return value.kind == Value::KindNumber || value.kind == Value::KindDate || value.kind == Value::KindString;
+}
+
+/// a row to sort with its sort values read upfront
+struct SortRow {
+	int index;
+	QVector<Value> values;
+};
+
+class SortRowLessThan {
+public:
+	explicit SortRowLessThan(const QVector<bool> &descending) : _descending(descending) { }
+
+	bool operator()(const SortRow &a, const SortRow &b) const
+	{
+		for (int i = 0; i < _descending.size(); ++i) {
+			int result = compareValues(a.values.at(i), b.values.at(i));
+			if (result) {
+				return _descending.at(i) ? result > 0 : result < 0;
+			}
+		}
+		return false;
+	}
+
+private:
+	QVector<bool> _descending;
+};
+
+static Value valueOfRow(const ParseObject *object, const QString &key)
+{
+	if (key == "objectId") {
+		Value value;
+		value.kind = object->objectId().isEmpty() ? Value::KindMissing : Value::KindString;
+		value.string = object->objectId();
+		return value;
+	}
+	if (key == "createdAt" || key == "updatedAt") {
+		QDateTime dateTime = key == "createdAt" ? object->createdAt() : object->updatedAt();
+		Value value;
+		value.kind = dateTime.isValid() ? Value::KindDate : Value::KindMissing;
+		value.number = dateTime.toMSecsSinceEpoch();
+		return value;
+	}
+	return ParseQueryEvaluator::valueFromData(object->value(key));
+}
+
+static Value valueOfRow(const QVariant &json, const QString &key)
+{
+	const QVariantMap map = json.toMap();
+	QVariantMap::const_iterator i = map.constFind(key);
+	return i != map.constEnd() ? ParseQueryEvaluator::valueFromJson(key, i.value()) : Value();
+}
+
+///
+
+ParseQueryEvaluator::ParseQueryEvaluator() { }
+
+ParseQueryEvaluator::~ParseQueryEvaluator() { }
+
+bool ParseQueryEvaluator::compile(const QVariantMap &where, const QVariantList &order, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	_predicates.clear();
+	_sortKeys.clear();
+
+	for (QVariantMap::const_iterator i = where.constBegin(); i != where.constEnd(); ++i) {
+		Predicate predicate;
+		predicate.key = i.key();
+
+		QVariantMap constraints = i.value().toMap();
+		for (QVariantMap::const_iterator j = constraints.constBegin(); j != constraints.constEnd(); ++j) {
+			Comparison comparison;
+			comparison.value = valueFromData(j.value());
+
+			if (j.key() == "$lt") {
+				comparison.op = OperatorLessThan;
+			}
+			else if (j.key() == "$lte") {
+				comparison.op = OperatorLessThanOrEqualTo;
+			}
+			else if (j.key() == "$gt") {
+				comparison.op = OperatorGreaterThan;
+			}
+			else if (j.key() == "$gte") {
+				comparison.op = OperatorGreaterThanOrEqualTo;
+			}
+			else if (j.key() == "$ne") {
+				comparison.op = OperatorNotEqualTo;
+			}
+			else {
+				*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType,
+										"unsupported constraint " + j.key());
+				return false;
+			}
+
+			if (!isComparable(comparison.value)) {
+				*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType,
+										"unsupported value for constraint on " + i.key());
+				return false;
+			}
+
+			predicate.comparisons.append(comparison);
+		}
+
+		_predicates.append(predicate);
+	}
+
+	foreach (const QVariant &entry, order) {
+		QVariantMap entryMap = entry.toMap();
+		SortKey sortKey;
+		sortKey.key = entryMap.value("key").toString();
+		sortKey.descending = entryMap.value("order").toInt() == Qt::DescendingOrder;
+		_sortKeys.append(sortKey);
+	}
+
+	return true;
+}
+
+QList<ParseObject *> ParseQueryEvaluator::filter(const QList<ParseObject *> &objects, int limit, int skip) const
+{
+	QList<ParseObject *> matching;
+	foreach (ParseObject *object, objects) {
+		if (matches(object)) {
+			matching.append(object);
+		}
+	}
+	return sortAndSlice(matching, limit, skip);
+}
+
+QVariantList ParseQueryEvaluator::filter(const QVariantList &jsonObjects, int limit, int skip) const
+{
+	QVariantList matching;
+	foreach (const QVariant &json, jsonObjects) {
+		if (matches(json.toMap())) {
+			matching.append(json);
+		}
+	}
+	return sortAndSlice(matching, limit, skip);
+}
+
+bool ParseQueryEvaluator::matches(const ParseObject *object) const
+{
+	foreach (const Predicate &predicate, _predicates) {
+		if (!matchesValue(predicate, valueOfRow(object, predicate.key))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ParseQueryEvaluator::matches(const QVariantMap &json) const
+{
+	foreach (const Predicate &predicate, _predicates) {
+		QVariantMap::const_iterator i = json.constFind(predicate.key);
+		if (!matchesValue(predicate, i != json.constEnd() ? valueFromJson(predicate.key, i.value()) : Value())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ParseQueryEvaluator::matchesValue(const Predicate &predicate, const Value &value) const
+{
+	foreach (const Comparison &comparison, predicate.comparisons) {
+		// values of another type are unequal to, but not less or greater than, the constraint
+		bool sameKind = value.kind == comparison.value.kind;
+		int result = sameKind ? compareValues(value, comparison.value) : 0;
+
+		bool matched;
+		switch (comparison.op) {
+		case OperatorLessThan:
+			matched = sameKind && result < 0;
+			break;
+		case OperatorLessThanOrEqualTo:
+			matched = sameKind && result <= 0;
+			break;
+		case OperatorGreaterThan:
+			matched = sameKind && result > 0;
+			break;
+		case OperatorGreaterThanOrEqualTo:
+			matched = sameKind && result >= 0;
+			break;
+		default:
+			matched = !sameKind || result != 0;
+			break;
+		}
+
+		if (!matched) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename T> QList<T> ParseQueryEvaluator::sortAndSlice(const QList<T> &rows, int limit, int skip) const
+{
+	int count = limit < 0 ? rows.size() - skip : qMin(limit, rows.size() - skip);
+	if (count <= 0) {
+		return QList<T>();
+	}
+
+	if (_sortKeys.isEmpty()) {
+		return rows.mid(skip, count);
+	}
+
+	// read every sort value once instead of in each comparison
+	QVector<SortRow> sortRows(rows.size());
+	QVector<bool> descending(_sortKeys.size());
+	for (int i = 0; i < _sortKeys.size(); ++i) {
+		descending[i] = _sortKeys.at(i).descending;
+	}
+	for (int i = 0; i < rows.size(); ++i) {
+		SortRow &sortRow = sortRows[i];
+		sortRow.index = i;
+		sortRow.values.reserve(_sortKeys.size());
+		foreach (const SortKey &sortKey, _sortKeys) {
+			sortRow.values.append(valueOfRow(rows.at(i), sortKey.key));
+		}
+	}
+
+	qStableSort(sortRows.begin(), sortRows.end(), SortRowLessThan(descending));
+
+	QList<T> result;
+	result.reserve(count);
+	for (int i = skip; i < skip + count; ++i) {
+		result.append(rows.at(sortRows.at(i).index));
+	}
+	return result;
+}
+
+Value ParseQueryEvaluator::valueFromData(const QVariant &data)
+{
+	Value value;
+
+	switch (data.type()) {
+	case QVariant::Invalid:
+		break;
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Double:
+		value.kind = Value::KindNumber;
+		value.number = data.toDouble();
+		break;
+	case QVariant::String:
+		value.kind = Value::KindString;
+		value.string = data.toString();
+		break;
+	case QVariant::DateTime:
+		if (data.toDateTime().isValid()) {
+			value.kind = Value::KindDate;
+			value.number = data.toDateTime().toMSecsSinceEpoch();
+		}
+		break;
+	default:
+		if (int(data.type()) == int(QMetaType::Float)) {
+			value.kind = Value::KindNumber;
+			value.number = data.toDouble();
+		}
+		else {
+			value.kind = Value::KindOther;
+		}
+		break;
+	}
+
+	return value;
+}
+
+Value ParseQueryEvaluator::valueFromJson(const QString &key, const QVariant &json)
+{
+	if (key == "createdAt" || key == "updatedAt") {
+		return valueFromData(ParseManager::dateTimeFromString(json.toString()));
+	}
+
+	if (json.type() == QVariant::Map) {
+		const QVariantMap map = json.toMap();
+		if (map.value("__type") == "Date") {
+			return valueFromData(ParseManager::dateTimeFromString(map.value("iso").toString()));
+		}
+		Value value;
+		value.kind = Value::KindOther;
+		return value;
+	}
+
+	return valueFromData(json);
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,96 @@
+/*
+ * ParseQueryEvaluator.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_QUERY_EVALUATOR_HPP_
+#define PARSEQT__PARSE_QUERY_EVALUATOR_HPP_
+
+#include <QList>
+#include <QVariant>
+#include <QVector>
+
+namespace parseqt {
+
+class ParseObject;
+class ParseError;
+
+/// Internal class - evaluates the constraints of ParseQuery in memory. The where map and order list
+/// are compiled once into comparisons on typed values, so that filtering and sorting compare numbers,
+/// dates and strings directly. Values of different types never match a comparison, and sort by type.
+
+class ParseQueryEvaluator {
+public:
+	ParseQueryEvaluator();
+	~ParseQueryEvaluator();
+
+	/// where and order as built by ParseQuery, false if a constraint can't be evaluated
+	bool compile(const QVariantMap &where, const QVariantList &order, ParseError **error);
+
+	/// filtering and sorting - the order of equal objects is kept, limit -1 keeps all
+	QList<ParseObject *> filter(const QList<ParseObject *> &objects, int limit = -1, int skip = 0) const;
+	QVariantList filter(const QVariantList &jsonObjects, int limit = -1, int skip = 0) const;
+
+	bool matches(const ParseObject *object) const;
+	bool matches(const QVariantMap &json) const;
+
+public:
+	struct Value {
+		enum Kind {
+			KindMissing = 0, // sorts first
+			KindNumber,
+			KindDate, // ms since epoch in number
+			KindString,
+			KindOther // not comparable
+		};
+
+		Value() : kind(KindMissing), number(0) { }
+
+		Kind kind;
+		double number;
+		QString string;
+	};
+
+	/// typed values of object data (as in ParseObject::value) and of json (as sent by the server)
+	static Value valueFromData(const QVariant &data);
+	static Value valueFromJson(const QString &key, const QVariant &json);
+
+private:
+	enum Operator {
+		OperatorLessThan,
+		OperatorLessThanOrEqualTo,
+		OperatorGreaterThan,
+		OperatorGreaterThanOrEqualTo,
+		OperatorNotEqualTo
+	};
+
+	struct Comparison {
+		Operator op;
+		Value value;
+	};
+
+	/// the comparisons on one key, so that each value is read once
+	struct Predicate {
+		QString key;
+		QVector<Comparison> comparisons;
+	};
+
+	struct SortKey {
+		QString key;
+		bool descending;
+	};
+
+	bool matchesValue(const Predicate &predicate, const Value &value) const;
+
+	template <typename T> QList<T> sortAndSlice(const QList<T> &rows, int limit, int skip) const;
+
+private:
+	QVector<Predicate> _predicates;
+	QVector<SortKey> _sortKeys;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_QUERY_EVALUATOR_HPP_ */
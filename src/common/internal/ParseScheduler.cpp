@@ -0,0 +1,506 @@
+/*
+ * ParseScheduler.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseScheduler.hpp"
+
+#include "ParseCompression.hpp"
+#include "ParseError.hpp"
+#include "ParseJson.hpp"
+#include "ParseManager.hpp"
+#include "ParseMetrics.hpp"
+
+#include <QtNetwork/QNetworkReply>
+
+#include <QCoreApplication>
+#include <QDateTime>
+
+#include <math.h>
+
+#define PQ_SCHEDULER_DEFAULT_MAX_CONCURRENT		6
+#define PQ_SCHEDULER_DEFAULT_TIMEOUT			30000
+#define PQ_SCHEDULER_TIMEOUT_INTERVAL			1000
+
+#define PQ_REPLY_RETRIES_PROPERTY	"parseqt_retries"
+#define PQ_REPLY_TIMED_OUT_PROPERTY	"parseqt_timedOut"
+
+namespace parseqt {
+
+ParseScheduler::RetryPolicy::RetryPolicy()
+	: maxAttempts(3), initialDelay(500), maxDelay(30000), multiplier(2), jitter(0.5), retryNonIdempotent(false)
+{
+	networkErrors << QNetworkReply::TimeoutError
+				  << QNetworkReply::ConnectionRefusedError
+				  << QNetworkReply::RemoteHostClosedError
+				  << QNetworkReply::HostNotFoundError
+				  << QNetworkReply::TemporaryNetworkFailureError
+				  << QNetworkReply::ProxyTimeoutError;
+	parseCodes << ParseError::ParseCodeInternalServerError
+			   << ParseError::ParseCodeConnectionFailed
+			   << ParseError::ParseCodeRequestLimitExceeded;
+}
+
+ParseScheduler::ParseScheduler(QNetworkAccessManager *accessManager, QObject *parent)
+	: QObject(parent), _accessManager(accessManager), _maxConcurrentRequests(PQ_SCHEDULER_DEFAULT_MAX_CONCURRENT),
+	  _requestsPerSecond(0), _burstSize(1), _requestTimeout(PQ_SCHEDULER_DEFAULT_TIMEOUT), _random(0),
+	  _tokens(1), _metrics(NULL), _dispatched(0), _totalWaitTime(0), _maxWaitTime(0)
+{
+	Q_ASSERT(accessManager);
+
+	_refilled.start();
+	_clock.start();
+
+	// retry delays differ between clients only with a seed of their own, xorshift needs it non-zero
+	_random = quint32(QDateTime::currentMSecsSinceEpoch() ^ QCoreApplication::applicationPid()) | 1;
+
+	_timer.setSingleShot(true);
+	connect(&_timer, SIGNAL(timeout()), this, SLOT(dispatch()));
+
+	_retryTimer.setSingleShot(true);
+	connect(&_retryTimer, SIGNAL(timeout()), this, SLOT(requeueDelayed()));
+
+	_timeoutTimer.setInterval(PQ_SCHEDULER_TIMEOUT_INTERVAL);
+	connect(&_timeoutTimer, SIGNAL(timeout()), this, SLOT(checkTimeouts()));
+}
+
+ParseScheduler::~ParseScheduler()
+{
+	for (int priority = PriorityBackground; priority <= PriorityInteractive; ++priority) {
+		qDeleteAll(_queues[priority]);
+	}
+	qDeleteAll(_inFlight);
+	qDeleteAll(_delayed);
+}
+
+int ParseScheduler::maxConcurrentRequests() const
+{
+	return _maxConcurrentRequests;
+}
+
+void ParseScheduler::setMaxConcurrentRequests(int maxConcurrentRequests)
+{
+	Q_ASSERT(maxConcurrentRequests > 0);
+
+	_maxConcurrentRequests = maxConcurrentRequests;
+	dispatch();
+}
+
+double ParseScheduler::requestsPerSecond() const
+{
+	return _requestsPerSecond;
+}
+
+void ParseScheduler::setRequestsPerSecond(double requestsPerSecond)
+{
+	Q_ASSERT(requestsPerSecond >= 0);
+
+	_requestsPerSecond = requestsPerSecond;
+	_tokens = qMin(_tokens, double(_burstSize));
+	dispatch();
+}
+
+int ParseScheduler::burstSize() const
+{
+	return _burstSize;
+}
+
+void ParseScheduler::setBurstSize(int burstSize)
+{
+	Q_ASSERT(burstSize > 0);
+
+	_burstSize = burstSize;
+	_tokens = qMin(_tokens, double(_burstSize));
+}
+
+ParseScheduler::RetryPolicy ParseScheduler::retryPolicy() const
+{
+	return _retryPolicy;
+}
+
+void ParseScheduler::setRetryPolicy(const RetryPolicy &retryPolicy)
+{
+	Q_ASSERT(retryPolicy.maxAttempts > 0);
+	Q_ASSERT(retryPolicy.jitter >= 0 && retryPolicy.jitter <= 1);
+
+	_retryPolicy = retryPolicy;
+}
+
+int ParseScheduler::requestTimeout() const
+{
+	return _requestTimeout;
+}
+
+void ParseScheduler::setRequestTimeout(int requestTimeout)
+{
+	Q_ASSERT(requestTimeout >= 0);
+
+	_requestTimeout = requestTimeout;
+	if (!_requestTimeout) {
+		_timeoutTimer.stop();
+	}
+	else if (!_inFlight.isEmpty()) {
+		_timeoutTimer.start();
+	}
+}
+
+void ParseScheduler::enqueue(Request *request)
+{
+	Q_ASSERT(request);
+
+	request->attempts = 0;
+	request->due = 0;
+	request->queued.start();
+	_queues[request->priority].append(request);
+	if (!request->key.isEmpty()) {
+		_shared.insert(request->key, request);
+	}
+
+	dispatch();
+}
+
+bool ParseScheduler::join(const QByteArray &key, QObject *receiver, const char *slot)
+{
+	Request *request = _shared.value(key);
+	if (!request) {
+		return false;
+	}
+
+	Receiver entry;
+	entry.object = receiver;
+	entry.slot = slot;
+
+	// remember the receiver in case the request is sent again
+	request->receivers.append(entry);
+	if (request->reply) {
+		connectReceiver(request->reply, entry);
+	}
+	return true;
+}
+
+int ParseScheduler::retries(QNetworkReply *reply)
+{
+	return reply->property(PQ_REPLY_RETRIES_PROPERTY).toInt();
+}
+
+bool ParseScheduler::timedOut(QNetworkReply *reply)
+{
+	return reply->property(PQ_REPLY_TIMED_OUT_PROPERTY).toBool();
+}
+
+void ParseScheduler::setMetrics(ParseMetrics *metrics)
+{
+	_metrics = metrics;
+}
+
+int ParseScheduler::queueDepth() const
+{
+	int depth = _delayed.size();
+	for (int priority = PriorityBackground; priority <= PriorityInteractive; ++priority) {
+		depth += _queues[priority].size();
+	}
+	return depth;
+}
+
+int ParseScheduler::inFlight() const
+{
+	return _inFlight.size();
+}
+
+int ParseScheduler::dispatched() const
+{
+	return _dispatched;
+}
+
+qint64 ParseScheduler::totalWaitTime() const
+{
+	return _totalWaitTime;
+}
+
+qint64 ParseScheduler::maxWaitTime() const
+{
+	return _maxWaitTime;
+}
+
+void ParseScheduler::dispatch()
+{
+	while (_inFlight.size() < _maxConcurrentRequests) {
+		Request *request = nextRequest();
+		if (!request || !takeToken()) {
+			return;
+		}
+		_queues[request->priority].removeFirst();
+
+		qint64 waitTime = request->queued.elapsed();
+		_totalWaitTime += waitTime;
+		_maxWaitTime = qMax(_maxWaitTime, waitTime);
+		++_dispatched;
+
+		send(request);
+	}
+}
+
+void ParseScheduler::replyFinished()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+
+	Request *request = _inFlight.take(reply);
+	if (_inFlight.isEmpty()) {
+		_timeoutTimer.stop();
+	}
+
+	if (request && shouldRetry(request, reply)) {
+		// the receivers are only connected to the reply of the final attempt
+		reply->disconnect();
+		reply->deleteLater();
+		scheduleRetry(request);
+	}
+	else if (request) {
+		reply->setProperty(PQ_REPLY_RETRIES_PROPERTY, request->attempts - 1);
+		release(request);
+	}
+
+	// the receivers of the reply are called after this slot as they connected later
+	dispatch();
+}
+
+void ParseScheduler::requeueDelayed()
+{
+	qint64 now = _clock.elapsed();
+	qint64 next = -1;
+
+	QMutableListIterator<Request *> i(_delayed);
+	while (i.hasNext()) {
+		Request *request = i.next();
+		if (request->due <= now) {
+			i.remove();
+			_queues[request->priority].prepend(request);
+		}
+		else if (next < 0 || request->due < next) {
+			next = request->due;
+		}
+	}
+
+	if (next >= 0) {
+		_retryTimer.start(int(next - now));
+	}
+
+	dispatch();
+}
+
+void ParseScheduler::checkTimeouts()
+{
+	QList<QNetworkReply *> expired;
+
+	QHashIterator<QNetworkReply *, Request *> i(_inFlight);
+	while (i.hasNext()) {
+		i.next();
+		if (i.value()->active.elapsed() > _requestTimeout) {
+			expired.append(i.key());
+		}
+	}
+
+	// aborting finishes the reply which removes it from the requests in flight
+	foreach (QNetworkReply *reply, expired) {
+		reply->setProperty(PQ_REPLY_TIMED_OUT_PROPERTY, true);
+		reply->abort();
+	}
+}
+
+void ParseScheduler::replyProgress()
+{
+	QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+
+	// a slow transfer is only timed out once it stalls
+	Request *request = _inFlight.value(reply);
+	if (request) {
+		request->active.restart();
+	}
+}
+
+bool ParseScheduler::shouldRetry(Request *request, QNetworkReply *reply) const
+{
+	if (request->attempts >= _retryPolicy.maxAttempts) {
+		return false;
+	}
+	if (request->op == QNetworkAccessManager::PostOperation && !_retryPolicy.retryNonIdempotent) {
+		return false;
+	}
+
+	int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+	// successful replies may already have been partially consumed by progress receivers,
+	// also when they stalled and timed out afterwards
+	if (status >= 200 && status < 300) {
+		foreach (const Receiver &receiver, request->receivers) {
+			if (!receiver.progressSlot.isEmpty()) {
+				return false;
+			}
+		}
+	}
+
+	if (timedOut(reply)) {
+		return _retryPolicy.networkErrors.contains(QNetworkReply::TimeoutError);
+	}
+
+	if (status >= 500 || status == 429) {
+		QByteArray body = reply->peek(reply->bytesAvailable());
+		if (ParseManager::isEncoded(reply)) {
+			QByteArray inflated;
+			ParseInflater::inflateAll(body, &inflated);
+			body = inflated;
+		}
+
+		ParseError *error = NULL;
+		QVariant json = ParseJson::read(body, &error);
+		delete error;
+
+		int code = json.toMap().value("code").toInt();
+		return _retryPolicy.parseCodes.contains(code ? code : int(ParseError::ParseCodeInternalServerError));
+	}
+
+	return reply->error() != QNetworkReply::NoError && _retryPolicy.networkErrors.contains(reply->error());
+}
+
+void ParseScheduler::scheduleRetry(Request *request)
+{
+	request->reply = NULL;
+
+	// exponential backoff with a randomized share to spread the retries of many clients
+	double delay = _retryPolicy.initialDelay * pow(_retryPolicy.multiplier, request->attempts - 1);
+	delay = qMin(delay, double(_retryPolicy.maxDelay));
+	delay = delay * (1 - _retryPolicy.jitter) + delay * _retryPolicy.jitter * random();
+
+	request->due = _clock.elapsed() + qint64(delay);
+
+	// the timer is due with the earliest delayed request
+	bool earliest = true;
+	foreach (const Request *delayed, _delayed) {
+		earliest &= request->due < delayed->due;
+	}
+	_delayed.append(request);
+
+	if (earliest || !_retryTimer.isActive()) {
+		_retryTimer.start(int(delay));
+	}
+}
+
+double ParseScheduler::random()
+{
+	// xorshift32 - a generator of its own leaves the sequence of qrand to the application
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+	return _random / 4294967296.0;
+}
+
+void ParseScheduler::release(Request *request)
+{
+	if (!request->key.isEmpty() && _shared.value(request->key) == request) {
+		_shared.remove(request->key);
+	}
+	delete request;
+}
+
+ParseScheduler::Request *ParseScheduler::nextRequest() const
+{
+	for (int priority = PriorityInteractive; priority >= PriorityBackground; --priority) {
+		if (!_queues[priority].isEmpty()) {
+			return _queues[priority].first();
+		}
+	}
+	return NULL;
+}
+
+bool ParseScheduler::takeToken()
+{
+	if (_requestsPerSecond <= 0) {
+		return true;
+	}
+
+	// token bucket: refill by the elapsed time, wait for the next token if empty
+	_tokens = qMin(double(_burstSize), _tokens + _refilled.restart() * _requestsPerSecond / 1000.0);
+	if (_tokens >= 1) {
+		_tokens -= 1;
+		return true;
+	}
+
+	if (!_timer.isActive()) {
+		_timer.start(int(ceil((1 - _tokens) * 1000.0 / _requestsPerSecond)));
+	}
+	return false;
+}
+
+void ParseScheduler::send(Request *request)
+{
+	QNetworkReply *reply = NULL;
+
+	switch (request->op) {
+	case QNetworkAccessManager::GetOperation:
+		reply = _accessManager->get(request->request);
+		break;
+
+	case QNetworkAccessManager::PutOperation:
+		reply = _accessManager->put(request->request, request->body);
+		break;
+
+	case QNetworkAccessManager::PostOperation:
+		reply = _accessManager->post(request->request, request->body);
+		break;
+
+	case QNetworkAccessManager::DeleteOperation:
+		reply = _accessManager->deleteResource(request->request);
+		break;
+
+	default:
+		break;
+	}
+
+	Q_ASSERT(reply);
+
+	// created before connecting replyFinished so it also sees the finish of attempts which are retried
+	if (_metrics) {
+		new ParseRequestMetrics(reply, _metrics, request->className, request->queued.nsecsElapsed() / 1000000.0, request->body.size());
+	}
+
+	request->reply = reply;
+	request->active.start();
+	++request->attempts;
+	_inFlight.insert(reply, request);
+
+	if (_requestTimeout && !_timeoutTimer.isActive()) {
+		_timeoutTimer.start();
+	}
+
+	// connect first so that replyFinished runs before the receivers
+	bool connected = connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+	Q_ASSERT(connected);
+	connected = connect(reply, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(replyProgress()));
+	Q_ASSERT(connected);
+	connected = connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(replyProgress()));
+	Q_ASSERT(connected);
+	Q_UNUSED(connected);
+
+	foreach (const Receiver &receiver, request->receivers) {
+		connectReceiver(reply, receiver);
+	}
+}
+
+void ParseScheduler::connectReceiver(QNetworkReply *reply, const Receiver &receiver)
+{
+	if (!receiver.object) {
+		return;
+	}
+
+	bool connected = connect(reply, SIGNAL(finished()), receiver.object, receiver.slot.constData());
+	Q_ASSERT(connected);
+	if (!receiver.progressSlot.isEmpty()) {
+		connected = connect(reply, SIGNAL(readyRead()), receiver.object, receiver.progressSlot.constData());
+		Q_ASSERT(connected);
+	}
+	Q_UNUSED(connected);
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,154 @@
+/*
+ * ParseScheduler.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_SCHEDULER_HPP_
+#define PARSEQT__PARSE_SCHEDULER_HPP_
+
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+
+namespace parseqt {
+
+class ParseMetrics;
+
+/// Internal class - queues requests by priority and hands them to the network access manager
+/// while staying within the limits for concurrent requests and requests per second.
+/// Requests failing for transient reasons are sent again after an exponential backoff, their
+/// receivers only see the reply of the final attempt.
+
+class ParseScheduler : public QObject {
+	Q_OBJECT
+
+public:
+	enum Priority {
+		PriorityAutomatic = -1, // derived from the operation by ParseManager::request
+		PriorityBackground = 0,
+		PriorityNormal = 1,
+		PriorityInteractive = 2
+	};
+
+	struct Receiver {
+		QPointer<QObject> object;
+		QByteArray slot;
+		QByteArray progressSlot;
+	};
+
+	struct Request {
+		QNetworkAccessManager::Operation op;
+		QNetworkRequest request;
+		QByteArray body;
+		Priority priority;
+		QByteArray key; // requests with the same non-empty key are sent only once
+		QString className; // for metrics
+		QList<Receiver> receivers;
+		QElapsedTimer queued;
+		QElapsedTimer active; // since the reply was sent or last made progress
+		QPointer<QNetworkReply> reply;
+		int attempts;
+		qint64 due; // when a delayed retry is to be queued again
+	};
+
+	struct RetryPolicy {
+		RetryPolicy();
+
+		int maxAttempts; // including the first one
+		int initialDelay; // ms
+		int maxDelay; // ms
+		double multiplier;
+		double jitter; // share of the delay which is randomized, from 0 to 1
+		bool retryNonIdempotent; // posts are not retried by default
+		QSet<int> networkErrors; // QNetworkReply::NetworkError values
+		QSet<int> parseCodes; // ParseError::ParseCode values
+	};
+
+	explicit ParseScheduler(QNetworkAccessManager *accessManager, QObject *parent = 0);
+	virtual ~ParseScheduler();
+
+	/// configuration - 0 requests per second disables rate limiting
+	int maxConcurrentRequests() const;
+	void setMaxConcurrentRequests(int maxConcurrentRequests);
+	double requestsPerSecond() const;
+	void setRequestsPerSecond(double requestsPerSecond);
+	int burstSize() const;
+	void setBurstSize(int burstSize);
+	RetryPolicy retryPolicy() const;
+	void setRetryPolicy(const RetryPolicy &retryPolicy);
+	int requestTimeout() const; // ms without any progress of a reply, 0 disables timeouts
+	void setRequestTimeout(int requestTimeout);
+
+	/// scheduling - takes ownership of request
+	void enqueue(Request *request);
+	bool join(const QByteArray &key, QObject *receiver, const char *slot);
+
+	/// properties of finished replies
+	static int retries(QNetworkReply *reply);
+	static bool timedOut(QNetworkReply *reply);
+
+	/// metrics - the optional per request metrics are recorded into metrics
+	void setMetrics(ParseMetrics *metrics);
+	int queueDepth() const;
+	int inFlight() const;
+	int dispatched() const;
+	qint64 totalWaitTime() const;
+	qint64 maxWaitTime() const;
+
+private:
+	Q_DISABLE_COPY(ParseScheduler)
+
+	Q_SLOT void dispatch();
+	Q_SLOT void replyFinished();
+	Q_SLOT void requeueDelayed();
+	Q_SLOT void checkTimeouts();
+	Q_SLOT void replyProgress();
+
+	bool shouldRetry(Request *request, QNetworkReply *reply) const;
+	void scheduleRetry(Request *request);
+	double random(); // from 0 to 1, exclusive
+	void release(Request *request);
+
+	Request *nextRequest() const;
+	bool takeToken();
+	void send(Request *request);
+	void connectReceiver(QNetworkReply *reply, const Receiver &receiver);
+
+private:
+	QNetworkAccessManager *_accessManager;
+	int _maxConcurrentRequests;
+	double _requestsPerSecond;
+	int _burstSize;
+
+	QList<Request *> _queues[PriorityInteractive + 1];
+	QHash<QNetworkReply *, Request *> _inFlight;
+	QHash<QByteArray, Request *> _shared;
+	QList<Request *> _delayed;
+
+	RetryPolicy _retryPolicy;
+	int _requestTimeout;
+	QElapsedTimer _clock;
+	QTimer _retryTimer;
+	QTimer _timeoutTimer;
+	quint32 _random; // state of the jitter generator
+
+	double _tokens;
+	QElapsedTimer _refilled;
+	QTimer _timer;
+
+	ParseMetrics *_metrics;
+	int _dispatched;
+	qint64 _totalWaitTime;
+	qint64 _maxWaitTime;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_SCHEDULER_HPP_ */
@@ -0,0 +1,178 @@
+/*
+ * ParseStreamReader.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseStreamReader.hpp"
+
+#include "ParseError.hpp"
+#include "ParseJson.hpp"
+
+namespace parseqt {
+
+ParseStreamReader::ParseStreamReader(const QByteArray &arrayKey)
+	: _arrayKey(arrayKey), _state(StateSeekArray), _depth(0), _inString(false), _escape(false),
+	  _stringStart(-1), _elementStart(-1)
+{
+}
+
+ParseStreamReader::~ParseStreamReader() { }
+
+bool ParseStreamReader::atEnd() const
+{
+	return _state == StateDone;
+}
+
+bool ParseStreamReader::feed(const QByteArray &data, QVariantList *elements, ParseError **error)
+{
+	Q_ASSERT(elements);
+	Q_ASSERT(error);
+
+	if (_state == StateDone) {
+		return true;
+	}
+
+	int pos = _buffer.size();
+	_buffer.append(data);
+	const char *bytes = _buffer.constData();
+	int size = _buffer.size();
+
+	for (; pos < size && _state != StateDone; ++pos) {
+		char c = bytes[pos];
+
+		if (_inString) {
+			if (_escape) {
+				_escape = false;
+			}
+			else if (c == '\\') {
+				_escape = true;
+			}
+			else if (c == '"') {
+				_inString = false;
+				if (_state == StateSeekArray && _depth == 1) {
+					_lastString = QByteArray(bytes + _stringStart, pos - _stringStart);
+				}
+			}
+			continue;
+		}
+
+		bool elementLevel = _state == StateInArray && _depth == 2;
+
+		switch (c) {
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			break;
+
+		case ':':
+			// only a string followed by a colon is a key, others are values
+			if (_state == StateSeekArray && _depth == 1) {
+				_key = _lastString;
+			}
+			break;
+
+		case '"':
+			_inString = true;
+			_stringStart = pos + 1;
+			if (elementLevel && _elementStart < 0) {
+				_elementStart = pos;
+			}
+			break;
+
+		case '{':
+		case '[':
+			if (_state == StateSeekArray && c == '[' && _depth == 1 && _key == _arrayKey) {
+				_state = StateInArray;
+			}
+			else if (elementLevel && _elementStart < 0) {
+				_elementStart = pos;
+			}
+			++_depth;
+			break;
+
+		case '}':
+		case ']':
+			if (--_depth < 0) {
+				*error = new ParseError(ParseError::DomainJson, ParseError::JsonCodeFailed, "unbalanced brackets");
+				return false;
+			}
+			if (_state == StateInArray) {
+				if (_depth == 1) {
+					if (_elementStart >= 0 && !appendElement(_elementStart, pos, elements, error)) {
+						return false;
+					}
+					_elementStart = -1;
+					_state = StateDone;
+				}
+				else if (_depth == 2 && _elementStart >= 0) {
+					if (!appendElement(_elementStart, pos + 1, elements, error)) {
+						return false;
+					}
+					_elementStart = -1;
+				}
+			}
+			break;
+
+		case ',':
+			if (_state == StateSeekArray && _depth == 1) {
+				_key.clear();
+			}
+			else if (elementLevel && _elementStart >= 0) {
+				if (!appendElement(_elementStart, pos, elements, error)) {
+					return false;
+				}
+				_elementStart = -1;
+			}
+			break;
+
+		default:
+			if (elementLevel && _elementStart < 0) {
+				_elementStart = pos;
+			}
+			break;
+		}
+	}
+
+	// drop everything which does not belong to a pending element or key
+	int keep = size;
+	if (_state == StateDone) {
+		_elementStart = -1;
+		_inString = false;
+	}
+	else if (_elementStart >= 0) {
+		keep = _elementStart;
+	}
+	else if (_inString) {
+		keep = _stringStart;
+	}
+
+	if (keep == size) {
+		_buffer.clear();
+	}
+	else if (keep > 0) {
+		_buffer.remove(0, keep);
+	}
+	if (_elementStart >= 0) {
+		_elementStart -= keep;
+	}
+	if (_inString) {
+		_stringStart -= keep;
+	}
+
+	return true;
+}
+
+bool ParseStreamReader::appendElement(int begin, int end, QVariantList *elements, ParseError **error)
+{
+	QVariant element = ParseJson::read(_buffer.mid(begin, end - begin), error);
+	if (!element.isValid()) {
+		return false;
+	}
+	elements->append(element);
+	return true;
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,58 @@
+/*
+ * ParseStreamReader.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_STREAM_READER_HPP_
+#define PARSEQT__PARSE_STREAM_READER_HPP_
+
+#include <QVariant>
+
+namespace parseqt {
+
+class ParseError;
+
+/// Internal class - decodes the elements of an array stored under a key of the top level
+/// json object (like "results" in query replies) while the document is still arriving.
+/// Only the bytes of the element currently being received are buffered.
+
+class ParseStreamReader {
+public:
+	explicit ParseStreamReader(const QByteArray &arrayKey);
+	~ParseStreamReader();
+
+	/// appends all elements completed by data to elements, returns false on malformed input
+	bool feed(const QByteArray &data, QVariantList *elements, ParseError **error);
+
+	/// true once the closing bracket of the array has been seen
+	bool atEnd() const;
+
+private:
+	Q_DISABLE_COPY(ParseStreamReader)
+
+	bool appendElement(int begin, int end, QVariantList *elements, ParseError **error);
+
+private:
+	enum State {
+		StateSeekArray,
+		StateInArray,
+		StateDone
+	};
+
+	QByteArray _arrayKey;
+	QByteArray _buffer;
+	QByteArray _lastString; // at the top level, key or value
+	QByteArray _key; // of the top level value being read
+	State _state;
+	int _depth;
+	bool _inString;
+	bool _escape;
+	int _stringStart;
+	int _elementStart;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_STREAM_READER_HPP_ */
@@ -0,0 +1,666 @@
+/*
+ * ParseJson.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseJson.hpp"
+
+#include "ParseError.hpp"
+
+#include <QDateTime>
+#include <QHash>
+#include <QStringList>
+#include <qnumeric.h>
+
+#include <limits.h>
+
+#define PQ_JSON_MAX_DEPTH		512
+#define PQ_JSON_MAX_KEY_CACHE	512
+
+namespace parseqt {
+
+/// Reader
+
+/// A single pass recursive descent parser working directly on the raw bytes.
+/// Values are parsed in place into their parent containers and object keys are
+/// shared between all rows of a document, so that result pages with many rows of
+/// the same class only hold one copy of each key.
+
+class JsonReader {
+public:
+	JsonReader(const QByteArray &buffer);
+
+	bool read(QVariant *result);
+	QString errorMessage() const { return _errorMessage; }
+
+private:
+	bool readValue(QVariant *result, int depth);
+	bool readObject(QVariant *result, int depth);
+	bool readArray(QVariant *result, int depth);
+	bool readString(QString *result);
+	bool readKey(QString *result);
+	bool readNumber(QVariant *result);
+	bool readLiteral(const char *literal, int length);
+	bool readEscapes(const char *begin);
+
+	void skipWhitespace();
+	bool fail(const char *message);
+
+private:
+	const char *_begin;
+	const char *_pos;
+	const char *_end;
+	QByteArray _scratch;
+	QHash<QByteArray, QString> _keys;
+	QString _errorMessage;
+};
+
+JsonReader::JsonReader(const QByteArray &buffer)
+	: _begin(buffer.constData()), _pos(buffer.constData()), _end(buffer.constData() + buffer.size())
+{
+	_scratch.reserve(64);
+}
+
+bool JsonReader::read(QVariant *result)
+{
+	skipWhitespace();
+	if (_pos == _end) {
+		return fail("empty document");
+	}
+	if (!readValue(result, 0)) {
+		return false;
+	}
+	skipWhitespace();
+	if (_pos != _end) {
+		return fail("garbage after document");
+	}
+	return true;
+}
+
+bool JsonReader::readValue(QVariant *result, int depth)
+{
+	if (depth > PQ_JSON_MAX_DEPTH) {
+		return fail("nesting too deep");
+	}
+
+	switch (*_pos) {
+	case '{':
+		return readObject(result, depth + 1);
+	case '[':
+		return readArray(result, depth + 1);
+	case '"': {
+		QString string;
+		if (!readString(&string)) {
+			return false;
+		}
+		*result = string;
+		return true;
+	}
+	case 't':
+		if (!readLiteral("true", 4)) {
+			return false;
+		}
+		*result = true;
+		return true;
+	case 'f':
+		if (!readLiteral("false", 5)) {
+			return false;
+		}
+		*result = false;
+		return true;
+	case 'n':
+		if (!readLiteral("null", 4)) {
+			return false;
+		}
+		*result = QVariant();
+		return true;
+	default:
+		return readNumber(result);
+	}
+}
+
+bool JsonReader::readObject(QVariant *result, int depth)
+{
+	++_pos; // '{'
+
+	*result = QVariantMap();
+	QVariantMap *map = static_cast<QVariantMap *>(result->data());
+
+	skipWhitespace();
+	if (_pos != _end && *_pos == '}') {
+		++_pos;
+		return true;
+	}
+
+	for (;;) {
+		skipWhitespace();
+		if (_pos == _end || *_pos != '"') {
+			return fail("expected key");
+		}
+
+		QString key;
+		if (!readKey(&key)) {
+			return false;
+		}
+
+		skipWhitespace();
+		if (_pos == _end || *_pos != ':') {
+			return fail("expected ':'");
+		}
+		++_pos;
+
+		skipWhitespace();
+		if (_pos == _end) {
+			return fail("unexpected end");
+		}
+		if (!readValue(&(*map)[key], depth)) {
+			return false;
+		}
+
+		skipWhitespace();
+		if (_pos == _end) {
+			return fail("unexpected end");
+		}
+		if (*_pos == ',') {
+			++_pos;
+			continue;
+		}
+		if (*_pos == '}') {
+			++_pos;
+			return true;
+		}
+		return fail("expected ',' or '}'");
+	}
+}
+
+bool JsonReader::readArray(QVariant *result, int depth)
+{
+	++_pos; // '['
+
+	*result = QVariantList();
+	QVariantList *list = static_cast<QVariantList *>(result->data());
+
+	skipWhitespace();
+	if (_pos != _end && *_pos == ']') {
+		++_pos;
+		return true;
+	}
+
+	for (;;) {
+		skipWhitespace();
+		if (_pos == _end) {
+			return fail("unexpected end");
+		}
+
+		list->append(QVariant());
+		if (!readValue(&list->last(), depth)) {
+			return false;
+		}
+
+		skipWhitespace();
+		if (_pos == _end) {
+			return fail("unexpected end");
+		}
+		if (*_pos == ',') {
+			++_pos;
+			continue;
+		}
+		if (*_pos == ']') {
+			++_pos;
+			return true;
+		}
+		return fail("expected ',' or ']'");
+	}
+}
+
+bool JsonReader::readString(QString *result)
+{
+	const char *begin = ++_pos; // '"'
+
+	// fast path: no escapes
+	while (_pos != _end && *_pos != '"' && *_pos != '\\') {
+		++_pos;
+	}
+	if (_pos == _end) {
+		return fail("unterminated string");
+	}
+	if (*_pos == '"') {
+		*result = QString::fromUtf8(begin, _pos - begin);
+		++_pos;
+		return true;
+	}
+
+	if (!readEscapes(begin)) {
+		return false;
+	}
+	*result = QString::fromUtf8(_scratch.constData(), _scratch.size());
+	return true;
+}
+
+bool JsonReader::readKey(QString *result)
+{
+	const char *begin = _pos + 1;
+	const char *end = begin;
+
+	while (end != _end && *end != '"' && *end != '\\') {
+		++end;
+	}
+	if (end == _end || *end != '"') {
+		return readString(result);
+	}
+
+	// lookup without copying the raw bytes
+	QByteArray raw(QByteArray::fromRawData(begin, end - begin));
+	QHash<QByteArray, QString>::const_iterator i = _keys.constFind(raw);
+	if (i != _keys.constEnd()) {
+		*result = i.value();
+	}
+	else {
+		*result = QString::fromUtf8(begin, end - begin);
+		if (_keys.size() < PQ_JSON_MAX_KEY_CACHE) {
+			_keys.insert(QByteArray(begin, end - begin), *result);
+		}
+	}
+
+	_pos = end + 1;
+	return true;
+}
+
+static void appendUtf8(QByteArray &buffer, uint code)
+{
+	if (code < 0x80) {
+		buffer.append(char(code));
+	}
+	else if (code < 0x800) {
+		buffer.append(char(0xc0 | (code >> 6)));
+		buffer.append(char(0x80 | (code & 0x3f)));
+	}
+	else if (code < 0x10000) {
+		buffer.append(char(0xe0 | (code >> 12)));
+		buffer.append(char(0x80 | ((code >> 6) & 0x3f)));
+		buffer.append(char(0x80 | (code & 0x3f)));
+	}
+	else {
+		buffer.append(char(0xf0 | (code >> 18)));
+		buffer.append(char(0x80 | ((code >> 12) & 0x3f)));
+		buffer.append(char(0x80 | ((code >> 6) & 0x3f)));
+		buffer.append(char(0x80 | (code & 0x3f)));
+	}
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+bool JsonReader::readEscapes(const char *begin)
+{
+	// the scratch buffer keeps its capacity between strings
+	_scratch.resize(0);
+	_scratch.append(begin, _pos - begin);
+
+	while (_pos != _end) {
+		char c = *_pos++;
+		if (c == '"') {
+			return true;
+		}
+		if (c != '\\') {
+			_scratch.append(c);
+			continue;
+		}
+		if (_pos == _end) {
+			break;
+		}
+
+		c = *_pos++;
+		switch (c) {
+		case '"':	_scratch.append('"'); break;
+		case '\\':	_scratch.append('\\'); break;
+		case '/':	_scratch.append('/'); break;
+		case 'b':	_scratch.append('\b'); break;
+		case 'f':	_scratch.append('\f'); break;
+		case 'n':	_scratch.append('\n'); break;
+		case 'r':	_scratch.append('\r'); break;
+		case 't':	_scratch.append('\t'); break;
+		case 'u': {
+			uint code = 0;
+			for (int i = 0; i < 4; ++i) {
+				int value = _pos != _end ? hexValue(*_pos++) : -1;
+				if (value < 0) {
+					return fail("invalid unicode escape");
+				}
+				code = (code << 4) | value;
+			}
+			if (code >= 0xd800 && code < 0xdc00 && _end - _pos >= 6 && _pos[0] == '\\' && _pos[1] == 'u') {
+				uint low = 0;
+				for (int i = 2; i < 6; ++i) {
+					int value = hexValue(_pos[i]);
+					if (value < 0) {
+						return fail("invalid unicode escape");
+					}
+					low = (low << 4) | value;
+				}
+				if (low >= 0xdc00 && low < 0xe000) {
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					_pos += 6;
+				}
+			}
+			if (code >= 0xd800 && code < 0xe000) {
+				// a surrogate without its other half has no utf-8 encoding
+				code = 0xfffd;
+			}
+			appendUtf8(_scratch, code);
+			break;
+		}
+		default:
+			return fail("invalid escape");
+		}
+	}
+
+	return fail("unterminated string");
+}
+
+bool JsonReader::readNumber(QVariant *result)
+{
+	const char *begin = _pos;
+	bool negative = false;
+	bool integral = true;
+
+	if (_pos != _end && *_pos == '-') {
+		negative = true;
+		++_pos;
+	}
+	if (_pos == _end || *_pos < '0' || *_pos > '9') {
+		return fail("unexpected character");
+	}
+
+	// accumulate integers directly, fall back to a double conversion for the rest
+	quint64 value = 0;
+	int digits = 0;
+	bool leadingZero = *_pos == '0';
+	while (_pos != _end && *_pos >= '0' && *_pos <= '9') {
+		value = value * 10 + (*_pos - '0');
+		++digits;
+		++_pos;
+	}
+	if (leadingZero && digits > 1) {
+		return fail("invalid number");
+	}
+	if (_pos != _end && *_pos == '.') {
+		integral = false;
+		++_pos;
+		while (_pos != _end && *_pos >= '0' && *_pos <= '9') {
+			++_pos;
+		}
+	}
+	if (_pos != _end && (*_pos == 'e' || *_pos == 'E')) {
+		integral = false;
+		++_pos;
+		if (_pos != _end && (*_pos == '+' || *_pos == '-')) {
+			++_pos;
+		}
+		while (_pos != _end && *_pos >= '0' && *_pos <= '9') {
+			++_pos;
+		}
+	}
+
+	if (integral && digits < 19) {
+		qint64 number = negative ? -qint64(value) : qint64(value);
+		if (number >= INT_MIN && number <= INT_MAX) {
+			*result = int(number);
+		}
+		else {
+			*result = number;
+		}
+		return true;
+	}
+
+	bool ok = false;
+	double number = QByteArray(begin, _pos - begin).toDouble(&ok);
+	if (!ok) {
+		return fail("invalid number");
+	}
+	*result = number;
+	return true;
+}
+
+bool JsonReader::readLiteral(const char *literal, int length)
+{
+	if (_end - _pos < length || qstrncmp(_pos, literal, length) != 0) {
+		return fail("unexpected character");
+	}
+	_pos += length;
+	return true;
+}
+
+void JsonReader::skipWhitespace()
+{
+	while (_pos != _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t')) {
+		++_pos;
+	}
+}
+
+bool JsonReader::fail(const char *message)
+{
+	if (_errorMessage.isEmpty()) {
+		_errorMessage = QString("%1 at offset %2").arg(message).arg(_pos - _begin);
+	}
+	return false;
+}
+
+/// Writer
+
+class JsonWriter {
+public:
+	JsonWriter(QByteArray *buffer);
+
+	bool write(const QVariant &value);
+	QString errorMessage() const { return _errorMessage; }
+
+private:
+	bool writeValue(const QVariant &value, int depth);
+	void writeString(const QByteArray &utf8);
+	bool fail(const QString &message);
+
+private:
+	QByteArray *_buffer;
+	QString _errorMessage;
+};
+
+JsonWriter::JsonWriter(QByteArray *buffer) : _buffer(buffer)
+{
+}
+
+bool JsonWriter::write(const QVariant &value)
+{
+	return writeValue(value, 0);
+}
+
+bool JsonWriter::writeValue(const QVariant &value, int depth)
+{
+	if (depth > PQ_JSON_MAX_DEPTH) {
+		return fail("nesting too deep");
+	}
+
+	switch (value.type()) {
+	case QVariant::Invalid:
+		_buffer->append("null");
+		return true;
+
+	case QVariant::Bool:
+		_buffer->append(value.toBool() ? "true" : "false");
+		return true;
+
+	case QVariant::Int:
+	case QVariant::LongLong:
+		_buffer->append(QByteArray::number(value.toLongLong()));
+		return true;
+
+	case QVariant::UInt:
+	case QVariant::ULongLong:
+		_buffer->append(QByteArray::number(value.toULongLong()));
+		return true;
+
+	case QVariant::Double: {
+		double number = value.toDouble();
+		if (qIsNaN(number) || qIsInf(number)) {
+			return fail("invalid number");
+		}
+		_buffer->append(QByteArray::number(number, 'g', 17));
+		return true;
+	}
+
+	case QVariant::String:
+		writeString(static_cast<const QString *>(value.constData())->toUtf8());
+		return true;
+
+	case QVariant::ByteArray:
+		writeString(*static_cast<const QByteArray *>(value.constData()));
+		return true;
+
+	case QVariant::DateTime:
+		writeString(value.toDateTime().toString(Qt::ISODate).toUtf8());
+		return true;
+
+	case QVariant::Map: {
+		const QVariantMap *map = static_cast<const QVariantMap *>(value.constData());
+		_buffer->append('{');
+		for (QVariantMap::const_iterator i = map->constBegin(); i != map->constEnd(); ++i) {
+			if (i != map->constBegin()) {
+				_buffer->append(',');
+			}
+			writeString(i.key().toUtf8());
+			_buffer->append(':');
+			if (!writeValue(i.value(), depth + 1)) {
+				return false;
+			}
+		}
+		_buffer->append('}');
+		return true;
+	}
+
+	case QVariant::List: {
+		const QVariantList *list = static_cast<const QVariantList *>(value.constData());
+		_buffer->append('[');
+		for (int i = 0; i < list->size(); ++i) {
+			if (i) {
+				_buffer->append(',');
+			}
+			if (!writeValue(list->at(i), depth + 1)) {
+				return false;
+			}
+		}
+		_buffer->append(']');
+		return true;
+	}
+
+	case QVariant::StringList: {
+		const QStringList *list = static_cast<const QStringList *>(value.constData());
+		_buffer->append('[');
+		for (int i = 0; i < list->size(); ++i) {
+			if (i) {
+				_buffer->append(',');
+			}
+			writeString(list->at(i).toUtf8());
+		}
+		_buffer->append(']');
+		return true;
+	}
+
+	default:
+		if (value.canConvert(QVariant::String)) {
+			writeString(value.toString().toUtf8());
+			return true;
+		}
+		return fail(QString("unsupported type: %1").arg(value.typeName()));
+	}
+}
+
+void JsonWriter::writeString(const QByteArray &utf8)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	const char *begin = utf8.constData();
+	const char *end = begin + utf8.size();
+
+	_buffer->append('"');
+
+	// copy runs of characters which need no escaping in one go
+	const char *run = begin;
+	for (const char *pos = begin; pos != end; ++pos) {
+		uchar c = *pos;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		_buffer->append(run, pos - run);
+		run = pos + 1;
+
+		switch (c) {
+		case '"':	_buffer->append("\\\""); break;
+		case '\\':	_buffer->append("\\\\"); break;
+		case '\b':	_buffer->append("\\b"); break;
+		case '\f':	_buffer->append("\\f"); break;
+		case '\n':	_buffer->append("\\n"); break;
+		case '\r':	_buffer->append("\\r"); break;
+		case '\t':	_buffer->append("\\t"); break;
+		default:
+			_buffer->append("\\u00");
+			_buffer->append(hex[c >> 4]);
+			_buffer->append(hex[c & 0xf]);
+			break;
+		}
+	}
+	_buffer->append(run, end - run);
+
+	_buffer->append('"');
+}
+
+bool JsonWriter::fail(const QString &message)
+{
+	_errorMessage = message;
+	return false;
+}
+
+///
+
+QByteArray ParseJson::write(const QVariant &json, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	QByteArray buffer;
+	buffer.reserve(256);
+
+	JsonWriter writer(&buffer);
+	if (!writer.write(json)) {
+		*error = new ParseError(ParseError::DomainJson, ParseError::JsonCodeFailed, writer.errorMessage());
+		return QByteArray();
+	}
+	return buffer;
+}
+
+QVariant ParseJson::read(const QByteArray &buffer, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	QVariant json;
+	JsonReader reader(buffer);
+	if (!reader.read(&json)) {
+		*error = new ParseError(ParseError::DomainJson, ParseError::JsonCodeFailed, reader.errorMessage());
+		return QVariant();
+	}
+	return json;
+}
+
+} /* namespace parseqt */
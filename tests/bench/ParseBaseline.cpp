@@ -0,0 +1,121 @@
+/*
+ * ParseBaseline.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseBaseline.hpp"
+
+#include "ParseError.hpp"
+
+#define PQ_DATETIME_FORMAT	"yyyy-MM-ddTHH:mm:ss.zzzZ"
+
+namespace parseqt {
+
+QDateTime ParseBaseline::dateTimeFromString(const QString &string)
+{
+	QDateTime dateTime(QDateTime::fromString(string, PQ_DATETIME_FORMAT));
+	dateTime.setTimeSpec(Qt::UTC);
+	return dateTime;
+}
+
+QString ParseBaseline::stringFromDateTime(const QDateTime &dateTime)
+{
+	QDateTime utcDateTime(dateTime.toUTC());
+	return utcDateTime.toString(PQ_DATETIME_FORMAT);
+}
+
+QVariant ParseBaseline::jsonify(const QVariant &data, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	QVariant::Type dataType = data.type();
+
+	if (dataType == QVariant::DateTime) {
+		QVariantMap result;
+		result.insert("__type", "Date");
+		result.insert("iso", stringFromDateTime(data.toDateTime()));
+		return result;
+	}
+	if (dataType == QVariant::ByteArray) {
+		QVariantMap result;
+		result.insert("__type", "Bytes");
+		result.insert("base64", data.toByteArray().toBase64());
+		return result;
+	}
+	if (dataType == QVariant::List) {
+		QVariantList result;
+		foreach (const QVariant &variant, data.toList()) {
+			QVariant json = jsonify(variant, error);
+			if (!json.isValid()) {
+				return json;
+			}
+			result.append(json);
+		}
+		return result;
+	}
+	if (dataType == QVariant::Map) {
+		QVariantMap result;
+		QVariantMap map = data.toMap();
+		foreach (const QString &key, map.keys()) {
+			QVariant json = jsonify(map.value(key), error);
+			if (!json.isValid()) {
+				return json;
+			}
+			result.insert(key, json);
+		}
+		return result;
+	}
+
+	return data;
+}
+
+QVariant ParseBaseline::objectify(const QVariant &json, ParseError **error)
+{
+	Q_ASSERT(error);
+
+	QVariant::Type dataType = json.type();
+
+	if (dataType == QVariant::List) {
+		QVariantList result;
+		foreach (const QVariant &variant, json.toList()) {
+			QVariant object = objectify(variant, error);
+			if (!object.isValid()) {
+				return object;
+			}
+			result.append(object);
+		}
+		return result;
+	}
+
+	if (dataType != QVariant::Map) {
+		return json;
+	}
+
+	QVariantMap map = json.toMap();
+	if (!map.contains("__type")) {
+		QVariantMap result;
+		foreach (const QString &key, map.keys()) {
+			QVariant object = objectify(map.value(key), error);
+			if (!object.isValid()) {
+				return object;
+			}
+			result.insert(key, object);
+		}
+		return result;
+	}
+
+	QString type = map.value("__type").toString();
+	if (type == "Date") {
+		return dateTimeFromString(map.value("iso").toString());
+	}
+	if (type == "Bytes") {
+		return QByteArray::fromBase64(map.value("base64").toByteArray());
+	}
+
+	*error = new ParseError(ParseError::DomainParseQt, ParseError::ParseQtInvalidType, "invalid type: " + type);
+	return QVariant();
+}
+
+} /* namespace parseqt */
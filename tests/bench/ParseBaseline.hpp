@@ -0,0 +1,35 @@
+/*
+ * ParseBaseline.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_BASELINE_HPP_
+#define PARSEQT__PARSE_BASELINE_HPP_
+
+#include <QDateTime>
+#include <QVariant>
+
+namespace parseqt {
+
+class ParseError;
+
+/// The conversions of ParseManager as they were before they were optimized, kept unchanged
+/// so that the benchmarks can report them next to the current ones - less the delegate, which
+/// the benchmarks don't set
+
+class ParseBaseline {
+public:
+	/// ifyers - recursing via toMap/toList and rebuilding every container
+	static QVariant jsonify(const QVariant &data, ParseError **error);
+	static QVariant objectify(const QVariant &json, ParseError **error);
+
+	/// dates - via the QDateTime format pattern
+	static QDateTime dateTimeFromString(const QString &string);
+	static QString stringFromDateTime(const QDateTime &dateTime);
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_BASELINE_HPP_ */
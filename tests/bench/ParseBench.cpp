@@ -0,0 +1,785 @@
+/*
+ * ParseBench.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseBench.hpp"
+
+#include "ParseBaseline.hpp"
+#include "StandinServer.hpp"
+#include "ParseObject.hpp"
+#include "ParseQuery.hpp"
+#include "ParseRows.hpp"
+#include "internal/ParseManager.hpp"
+#include "ParseError.hpp"
+#include "ParseJson.hpp"
+
+#include <QtTest/QtTest>
+#include <QtNetwork/QHostAddress>
+#include <QDir>
+
+#define PQ_BENCH_DEFAULT_ROWS	"10,100,1000"
+#define PQ_BENCH_DEFAULT_FIELDS	"8,32"
+#define PQ_BENCH_DEFAULT_DEPTHS	"2,8,32"
+#define PQ_BENCH_DATES			1000
+#define PQ_BENCH_FILTER_LIMIT	100
+
+namespace parseqt {
+
+/// the sizes listed in the environment variable, or the defaults
+static QList<int> sizes(const char *variable, const char *defaults)
+{
+	QByteArray value = qgetenv(variable);
+	if (value.isEmpty()) {
+		value = defaults;
+	}
+
+	QList<int> result;
+	foreach (const QByteArray &size, value.split(',')) {
+		int n = size.trimmed().toInt();
+		if (n > 0) {
+			result.append(n);
+		}
+	}
+	return result;
+}
+
+ParseBench::ParseBench() : _server(NULL) { }
+
+ParseBench::~ParseBench() { }
+
+QVariantMap ParseBench::jsonRow(int index, int fields)
+{
+	static const QDateTime epoch(QDate(2013, 1, 1), QTime(0, 0), Qt::UTC);
+	QString timestamp = ParseManager::stringFromDateTime(epoch.addSecs(index));
+
+	QVariantMap row;
+	row.insert("objectId", QString("o%1").arg(index, 9, 10, QChar('0')));
+	row.insert("createdAt", timestamp);
+	row.insert("updatedAt", timestamp);
+
+	// a mix of the value types of typical rows
+	for (int i = 0; i < fields; ++i) {
+		QString key = QString("field%1").arg(i);
+		switch (i % 5) {
+		case 0:
+			row.insert(key, QString::fromUtf8("value %1 of row %2, \"quoted\" and \xc3\xa9").arg(i).arg(index));
+			break;
+		case 1:
+			row.insert(key, index * 0.5 + i);
+			break;
+		case 2:
+			row.insert(key, (index + i) % 2 == 0);
+			break;
+		case 3: {
+			QVariantMap date;
+			date.insert("__type", "Date");
+			date.insert("iso", ParseManager::stringFromDateTime(epoch.addSecs(index * 60 + i)));
+			row.insert(key, date);
+			break;
+		}
+		default: {
+			QVariantList list;
+			list << i << QString("tag%1").arg(index % 10) << index;
+			row.insert(key, list);
+			break;
+		}
+		}
+	}
+	return row;
+}
+
+QVariantMap ParseBench::objectValues(int index, int fields)
+{
+	ParseError *error = NULL;
+	QVariantMap values = ParseManager::instance()->objectify(jsonRow(index, fields), &error).toMap();
+	delete error;
+
+	values.remove("objectId");
+	values.remove("createdAt");
+	values.remove("updatedAt");
+	return values;
+}
+
+void ParseBench::addFilter(ParseQuery *query, int rows)
+{
+	// the later half of the rows by a number field, newest first, as a list screen shows them
+	query->whereGreaterThanOrEqualTo("field1", 1 + rows * 0.25);
+	query->orderByDescending("field1");
+	query->setLimit(PQ_BENCH_FILTER_LIMIT);
+}
+
+int ParseBench::filterResults(int rows)
+{
+	return qMin(rows / 2, PQ_BENCH_FILTER_LIMIT);
+}
+
+QVariantMap ParseBench::jsonDocument(int rows, int fields)
+{
+	QVariantList results;
+	results.reserve(rows);
+	for (int i = 0; i < rows; ++i) {
+		results.append(jsonRow(i, fields));
+	}
+
+	QVariantMap document;
+	document.insert("results", results);
+	return document;
+}
+
+QVariantMap ParseBench::escapedDocument(int rows, int fields)
+{
+	// strings full of escapes, quotes and non ascii characters as in user generated text
+	QString text = QString::fromUtf8("line\tone\nline \"two\" \\ caf\xc3\xa9 \xe2\x82\xac / end");
+
+	QVariantList results;
+	results.reserve(rows);
+	for (int i = 0; i < rows; ++i) {
+		QVariantMap row;
+		row.insert("objectId", QString("o%1").arg(i, 9, 10, QChar('0')));
+		for (int j = 0; j < fields; ++j) {
+			row.insert(QString("text%1").arg(j), text.repeated(1 + j % 4));
+		}
+		results.append(row);
+	}
+
+	QVariantMap document;
+	document.insert("results", results);
+	return document;
+}
+
+QVariantMap ParseBench::nestedDocument(int depth, int width)
+{
+	// width values per level, one of them a list holding the next level
+	QVariantMap level;
+	for (int d = depth - 1; d >= 0; --d) {
+		QVariantMap map;
+		for (int i = 0; i < width; ++i) {
+			QString key = QString("key%1").arg(i);
+			switch (i % 4) {
+			case 0:
+				map.insert(key, QString("value %1 at %2").arg(i).arg(d));
+				break;
+			case 1:
+				map.insert(key, d * 1000 + i);
+				break;
+			case 2:
+				map.insert(key, i % 3 == 0);
+				break;
+			default:
+				map.insert(key, QVariantList() << i << d);
+				break;
+			}
+		}
+		if (!level.isEmpty()) {
+			map.insert("child", QVariantList() << level);
+		}
+		level = map;
+	}
+	return level;
+}
+
+QVariantMap ParseBench::dateDocument(int rows, int fields)
+{
+	static const QDateTime epoch(QDate(2013, 1, 1), QTime(0, 0), Qt::UTC);
+
+	QVariantList results;
+	results.reserve(rows);
+	for (int i = 0; i < rows; ++i) {
+		QVariantMap row;
+		row.insert("objectId", QString("o%1").arg(i, 9, 10, QChar('0')));
+		for (int j = 0; j < fields; ++j) {
+			QVariantMap date;
+			date.insert("__type", "Date");
+			date.insert("iso", ParseManager::stringFromDateTime(epoch.addMSecs(qint64(i) * 86400123 + j * 1001)));
+			row.insert(QString("date%1").arg(j), date);
+		}
+		results.append(row);
+	}
+
+	QVariantMap document;
+	document.insert("results", results);
+	return document;
+}
+
+/// PQ_BENCH_DATES distinct timestamps, with milliseconds
+static QList<QDateTime> benchDates()
+{
+	static const QDateTime epoch(QDate(2013, 1, 1), QTime(0, 0), Qt::UTC);
+
+	QList<QDateTime> dates;
+	for (int i = 0; i < PQ_BENCH_DATES; ++i) {
+		dates.append(epoch.addMSecs(qint64(i) * 7654321 + i));
+	}
+	return dates;
+}
+
+void ParseBench::addRowsAndFields(bool baseline)
+{
+	QTest::addColumn<int>("rows");
+	QTest::addColumn<int>("fields");
+	QTest::addColumn<bool>("baseline");
+
+	foreach (int rows, sizes("PARSEQT_BENCH_ROWS", PQ_BENCH_DEFAULT_ROWS)) {
+		foreach (int fields, sizes("PARSEQT_BENCH_FIELDS", PQ_BENCH_DEFAULT_FIELDS)) {
+			QString name = QString("%1x%2").arg(rows).arg(fields);
+			QTest::newRow(name.toLatin1().constData()) << rows << fields << false;
+			if (baseline) {
+				QTest::newRow((name + " baseline").toLatin1().constData()) << rows << fields << true;
+			}
+		}
+	}
+}
+
+void ParseBench::addRowsAndSources(const QStringList &sources)
+{
+	QTest::addColumn<int>("rows");
+	QTest::addColumn<int>("fields");
+	QTest::addColumn<QString>("source");
+
+	foreach (int rows, sizes("PARSEQT_BENCH_ROWS", PQ_BENCH_DEFAULT_ROWS)) {
+		foreach (int fields, sizes("PARSEQT_BENCH_FIELDS", PQ_BENCH_DEFAULT_FIELDS)) {
+			QString name = QString("%1x%2").arg(rows).arg(fields);
+			foreach (const QString &source, sources) {
+				QTest::newRow((name + " " + source).toLatin1().constData()) << rows << fields << source;
+			}
+		}
+	}
+}
+
+void ParseBench::addBaseline()
+{
+	QTest::addColumn<bool>("baseline");
+
+	QTest::newRow("current") << false;
+	QTest::newRow("baseline") << true;
+}
+
+void ParseBench::addDepthsAndWidths()
+{
+	QTest::addColumn<int>("depth");
+	QTest::addColumn<int>("width");
+	QTest::addColumn<bool>("baseline");
+
+	foreach (int depth, sizes("PARSEQT_BENCH_DEPTHS", PQ_BENCH_DEFAULT_DEPTHS)) {
+		foreach (int width, sizes("PARSEQT_BENCH_FIELDS", PQ_BENCH_DEFAULT_FIELDS)) {
+			QString name = QString("%1x%2").arg(depth).arg(width);
+			QTest::newRow(name.toLatin1().constData()) << depth << width << false;
+			QTest::newRow((name + " baseline").toLatin1().constData()) << depth << width << true;
+		}
+	}
+}
+
+void ParseBench::addFields()
+{
+	QTest::addColumn<int>("fields");
+
+	foreach (int fields, sizes("PARSEQT_BENCH_FIELDS", PQ_BENCH_DEFAULT_FIELDS)) {
+		QTest::newRow(QString::number(fields).toLatin1().constData()) << fields;
+	}
+}
+
+void ParseBench::initTestCase()
+{
+	qRegisterMetaType<parseqt::ParseError *>("parseqt::ParseError*");
+
+	_server = new StandinServer(StandinServer::Options(), this);
+	QVERIFY(_server->listen(QHostAddress::LocalHost, 0));
+
+	ParseManager *manager = ParseManager::instance();
+	manager->setServerUrl(QUrl(QString("http://127.0.0.1:%1/1/").arg(_server->serverPort())));
+	manager->setApplicationId("bench");
+	manager->setApiKey("bench");
+	manager->setStorageDirectory(QDir::tempPath() + "/parseqt-bench-" + QString::number(QCoreApplication::applicationPid()));
+}
+
+void ParseBench::cleanupTestCase()
+{
+	ParseManager::instance()->cache()->clear();
+
+	delete _server;
+	_server = NULL;
+}
+
+///
+
+void ParseBench::jsonRead_data()
+{
+	addRowsAndFields();
+}
+
+void ParseBench::jsonRead()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+
+	ParseError *error = NULL;
+	QByteArray body = ParseJson::write(jsonDocument(rows, fields), &error);
+	QVERIFY(!error);
+
+	QVariant json;
+	QBENCHMARK {
+		json = ParseJson::read(body, &error);
+	}
+	QVERIFY(!error);
+	QCOMPARE(json.toMap().value("results").toList().size(), rows);
+}
+
+void ParseBench::jsonReadEscaped_data()
+{
+	addRowsAndFields();
+}
+
+void ParseBench::jsonReadEscaped()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+
+	ParseError *error = NULL;
+	QByteArray body = ParseJson::write(escapedDocument(rows, fields), &error);
+	QVERIFY(!error);
+
+	QVariant json;
+	QBENCHMARK {
+		json = ParseJson::read(body, &error);
+	}
+	QVERIFY(!error);
+	QCOMPARE(json, QVariant(escapedDocument(rows, fields)));
+}
+
+void ParseBench::jsonWrite_data()
+{
+	addRowsAndFields();
+}
+
+void ParseBench::jsonWrite()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+
+	QVariant json = jsonDocument(rows, fields);
+
+	ParseError *error = NULL;
+	QByteArray body;
+	QBENCHMARK {
+		body = ParseJson::write(json, &error);
+	}
+	QVERIFY(!error);
+	QVERIFY(!body.isEmpty());
+}
+
+void ParseBench::jsonify_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::jsonify()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	ParseManager *manager = ParseManager::instance();
+	ParseError *error = NULL;
+	QVariant data = manager->objectify(jsonDocument(rows, fields), &error);
+	QVERIFY(!error);
+
+	QVariant json;
+	if (baseline) {
+		QBENCHMARK {
+			json = ParseBaseline::jsonify(data, &error);
+		}
+	}
+	else {
+		QBENCHMARK {
+			json = manager->jsonify(data, &error);
+		}
+	}
+	QVERIFY(!error);
+	QCOMPARE(json, QVariant(jsonDocument(rows, fields)));
+}
+
+void ParseBench::objectify_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::objectify()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	ParseManager *manager = ParseManager::instance();
+	QVariant json = jsonDocument(rows, fields);
+
+	ParseError *error = NULL;
+	QVariant data;
+	if (baseline) {
+		QBENCHMARK {
+			data = ParseBaseline::objectify(json, &error);
+		}
+	}
+	else {
+		QBENCHMARK {
+			data = manager->objectify(json, &error);
+		}
+	}
+	QVERIFY(!error);
+	QVERIFY(data.isValid());
+}
+
+void ParseBench::jsonifyNested_data()
+{
+	addDepthsAndWidths();
+}
+
+void ParseBench::jsonifyNested()
+{
+	QFETCH(int, depth);
+	QFETCH(int, width);
+	QFETCH(bool, baseline);
+
+	ParseManager *manager = ParseManager::instance();
+	QVariant data = nestedDocument(depth, width);
+
+	ParseError *error = NULL;
+	QVariant json;
+	if (baseline) {
+		QBENCHMARK {
+			json = ParseBaseline::jsonify(data, &error);
+		}
+	}
+	else {
+		QBENCHMARK {
+			json = manager->jsonify(data, &error);
+		}
+	}
+	QVERIFY(!error);
+	QCOMPARE(json, data);
+}
+
+void ParseBench::objectifyNested_data()
+{
+	addDepthsAndWidths();
+}
+
+void ParseBench::objectifyNested()
+{
+	QFETCH(int, depth);
+	QFETCH(int, width);
+	QFETCH(bool, baseline);
+
+	ParseManager *manager = ParseManager::instance();
+	QVariant json = nestedDocument(depth, width);
+
+	ParseError *error = NULL;
+	QVariant data;
+	if (baseline) {
+		QBENCHMARK {
+			data = ParseBaseline::objectify(json, &error);
+		}
+	}
+	else {
+		QBENCHMARK {
+			data = manager->objectify(json, &error);
+		}
+	}
+	QVERIFY(!error);
+	QCOMPARE(data, json);
+}
+
+void ParseBench::objectifyDates_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::objectifyDates()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	ParseManager *manager = ParseManager::instance();
+	QVariant json = dateDocument(rows, fields);
+
+	ParseError *error = NULL;
+	QVariant data;
+	if (baseline) {
+		QBENCHMARK {
+			data = ParseBaseline::objectify(json, &error);
+		}
+	}
+	else {
+		QBENCHMARK {
+			data = manager->objectify(json, &error);
+		}
+	}
+	QVERIFY(!error);
+	QCOMPARE(data, ParseBaseline::objectify(json, &error));
+}
+
+void ParseBench::dateTimeFromString_data()
+{
+	addBaseline();
+}
+
+void ParseBench::dateTimeFromString()
+{
+	QFETCH(bool, baseline);
+
+	QList<QDateTime> dates = benchDates();
+	QStringList strings;
+	foreach (const QDateTime &date, dates) {
+		strings.append(ParseBaseline::stringFromDateTime(date));
+	}
+
+	QList<QDateTime> parsed;
+	if (baseline) {
+		QBENCHMARK {
+			parsed.clear();
+			foreach (const QString &string, strings) {
+				parsed.append(ParseBaseline::dateTimeFromString(string));
+			}
+		}
+	}
+	else {
+		QBENCHMARK {
+			parsed.clear();
+			foreach (const QString &string, strings) {
+				parsed.append(ParseManager::dateTimeFromString(string));
+			}
+		}
+	}
+	QCOMPARE(parsed, dates);
+}
+
+void ParseBench::stringFromDateTime_data()
+{
+	addBaseline();
+}
+
+void ParseBench::stringFromDateTime()
+{
+	QFETCH(bool, baseline);
+
+	QList<QDateTime> dates = benchDates();
+
+	QStringList strings;
+	if (baseline) {
+		QBENCHMARK {
+			strings.clear();
+			foreach (const QDateTime &date, dates) {
+				strings.append(ParseBaseline::stringFromDateTime(date));
+			}
+		}
+	}
+	else {
+		QBENCHMARK {
+			strings.clear();
+			foreach (const QDateTime &date, dates) {
+				strings.append(ParseManager::stringFromDateTime(date));
+			}
+		}
+	}
+	QCOMPARE(strings.size(), dates.size());
+	QCOMPARE(strings.last(), ParseBaseline::stringFromDateTime(dates.last()));
+}
+
+void ParseBench::constraints_data()
+{
+	addFields();
+}
+
+void ParseBench::constraints()
+{
+	QFETCH(int, fields);
+
+	ParseQuery query;
+	query.setClassName("Bench");
+	query.setLimit(100);
+	query.setSkip(100);
+
+	// one constraint per field, every other one on a date
+	for (int i = 0; i < fields; ++i) {
+		QString key = QString("field%1").arg(i);
+		if (i % 2) {
+			query.whereGreaterThan(key, QDateTime(QDate(2013, 1, 1), QTime(0, 0), Qt::UTC).addSecs(i));
+		}
+		else {
+			query.whereLessThan(key, i);
+		}
+	}
+	query.orderByAscending("createdAt");
+
+	// a CacheOnly miss encodes the constraints as for a request, then only looks up the cache
+	query.setCachePolicy(ParseQuery::CacheOnly);
+
+	QSignalSpy spy(&query, SIGNAL(findObjectsCompleted(QVariant,parseqt::ParseError*)));
+	QBENCHMARK {
+		query.findObjects();
+	}
+	QVERIFY(!spy.isEmpty());
+	ParseError *error = spy.last().at(1).value<ParseError *>();
+	QVERIFY(error);
+	QCOMPARE(error->code(), int(ParseError::ParseCodeCacheMiss));
+
+	QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void ParseBench::localDatastore_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::localDatastore()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	// the same rows pinned, and at hand as json - the baseline filters them in memory instead of
+	// querying the indexes of the local datastore
+	QString className = QString("BenchLocal%1x%2").arg(rows).arg(fields);
+	QVariantList jsonRows = jsonDocument(rows, fields).value("results").toList();
+	QList<ParseObject *> objects;
+	foreach (const QVariant &object, ParseRows(className, jsonRows).toList()) {
+		objects.append(object.value<ParseObject *>());
+	}
+	QVERIFY(ParseObject::pinAll(objects));
+
+	ParseQuery query;
+	query.setClassName(className);
+	query.setLazyResults(true);
+	addFilter(&query, rows);
+
+	int results = 0;
+	if (baseline) {
+		QBENCHMARK {
+			results = query.filterObjects(jsonRows).toList().size();
+		}
+	}
+	else {
+		query.fromLocalDatastore();
+
+		// local queries complete right away
+		QSignalSpy spy(&query, SIGNAL(findObjectsCompleted(QVariant,parseqt::ParseError*)));
+		QBENCHMARK {
+			spy.clear();
+			query.findObjects();
+			results = spy.first().at(0).value<ParseRows>().size();
+		}
+		QVERIFY(!spy.first().at(1).value<ParseError *>());
+	}
+	QCOMPARE(results, filterResults(rows));
+
+	QVERIFY(ParseObject::unpinAll(objects));
+	qDeleteAll(objects);
+}
+
+void ParseBench::setValues_data()
+{
+	addFields();
+}
+
+void ParseBench::setValues()
+{
+	QFETCH(int, fields);
+
+	// values alternate, so that every write changes them
+	QVariantMap values[2] = { objectValues(0, fields), objectValues(1, fields) };
+
+	ParseObject object;
+	object.setClassName("Bench");
+
+	int row = 0;
+	QBENCHMARK {
+		const QVariantMap &rowValues = values[row++ & 1];
+		for (QVariantMap::const_iterator it = rowValues.constBegin(); it != rowValues.constEnd(); ++it) {
+			object.setValue(it.key(), it.value());
+		}
+	}
+	QCOMPARE(object.dirtyKeys().size(), values[0].size());
+}
+
+void ParseBench::createdAt_data()
+{
+	addBaseline();
+}
+
+void ParseBench::createdAt()
+{
+	QFETCH(bool, baseline);
+
+	// an object as loaded from a result row
+	QVariantMap json = jsonRow(0, 0);
+	ParseRows rows("Bench", QVariantList() << json);
+	QScopedPointer<ParseObject> object(rows.at(0));
+
+	// the baseline parsed the createdAt string of the snapshot on every read, as bindings do
+	QString createdAtString = json.value("createdAt").toString();
+	QDateTime createdAt;
+	if (baseline) {
+		QBENCHMARK {
+			for (int i = 0; i < PQ_BENCH_DATES; ++i) {
+				createdAt = ParseBaseline::dateTimeFromString(createdAtString);
+			}
+		}
+	}
+	else {
+		QBENCHMARK {
+			for (int i = 0; i < PQ_BENCH_DATES; ++i) {
+				createdAt = object->createdAt();
+			}
+		}
+	}
+	QCOMPARE(createdAt, object->createdAt());
+}
+
+void ParseBench::readRows_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::readRows()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	// a list reading one value of every row of a page - the baseline creates an object for every
+	// row first, as findObjects did without lazy results
+	QVariantList jsonRows = jsonDocument(rows, fields).value("results").toList();
+
+	QVariant value;
+	if (baseline) {
+		QBENCHMARK {
+			foreach (const QVariant &result, ParseRows("Bench", jsonRows).toList()) {
+				ParseObject *object = result.value<ParseObject *>();
+				value = object->value("field0");
+				delete object;
+			}
+		}
+	}
+	else {
+		QBENCHMARK {
+			ParseRows results("Bench", jsonRows);
+			for (int i = 0; i < results.size(); ++i) {
+				value = results.value(i, "field0");
+			}
+		}
+	}
+	QCOMPARE(value, objectValues(rows - 1, fields).value("field0"));
+}
+
+} /* namespace parseqt */
+
+/// QTEST_MAIN would need a gui application in Qt 4
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	parseqt::ParseBench bench;
+	return QTest::qExec(&bench, argc, argv);
+}
@@ -0,0 +1,118 @@
+/*
+ * ParseBench.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__PARSE_BENCH_HPP_
+#define PARSEQT__PARSE_BENCH_HPP_
+
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QVariant>
+
+namespace parseqt {
+
+class StandinServer;
+class ParseQuery;
+
+/// QBENCHMARK suite of the client hot paths, measured through the API the library offers to
+/// applications, from Json decoding to whole requests against an in-process stand-in server.
+/// Payloads are rows x fields as in findObjects results, their sizes come from the comma
+/// separated PARSEQT_BENCH_ROWS and PARSEQT_BENCH_FIELDS environment variables
+/// (PARSEQT_BENCH_DEPTHS for nested documents).
+/// Results are reported in any QTest format, e.g. "bench -xml -o results.xml" to track releases.
+
+class ParseBench : public QObject {
+	Q_OBJECT
+
+public:
+	ParseBench();
+	virtual ~ParseBench();
+
+	/// payloads as the server sends them
+	static QVariantMap jsonRow(int index, int fields);
+	static QVariantMap jsonDocument(int rows, int fields);
+	static QVariantMap escapedDocument(int rows, int fields);
+	static QVariantMap nestedDocument(int depth, int width); // without dates, as most documents
+	static QVariantMap dateDocument(int rows, int fields); // every field a date
+
+	/// the values of a row as the application reads them, without the object metadata
+	static QVariantMap objectValues(int index, int fields);
+
+	/// the constraints of the filtering benchmarks on rows as above, and the number of results
+	static void addFilter(ParseQuery *query, int rows);
+	static int filterResults(int rows);
+
+private:
+	Q_SLOT void initTestCase();
+	Q_SLOT void cleanupTestCase();
+
+	/// ParseJson
+	Q_SLOT void jsonRead_data();
+	Q_SLOT void jsonRead();
+	Q_SLOT void jsonReadEscaped_data();
+	Q_SLOT void jsonReadEscaped();
+	Q_SLOT void jsonWrite_data();
+	Q_SLOT void jsonWrite();
+
+	/// ParseManager
+	Q_SLOT void jsonify_data();
+	Q_SLOT void jsonify();
+	Q_SLOT void objectify_data();
+	Q_SLOT void objectify();
+	Q_SLOT void jsonifyNested_data();
+	Q_SLOT void jsonifyNested();
+	Q_SLOT void objectifyNested_data();
+	Q_SLOT void objectifyNested();
+	Q_SLOT void objectifyDates_data();
+	Q_SLOT void objectifyDates();
+	Q_SLOT void dateTimeFromString_data();
+	Q_SLOT void dateTimeFromString();
+	Q_SLOT void stringFromDateTime_data();
+	Q_SLOT void stringFromDateTime();
+
+	/// ParseQuery
+	Q_SLOT void constraints_data();
+	Q_SLOT void constraints();
+	Q_SLOT void localDatastore_data();
+	Q_SLOT void localDatastore();
+	Q_SLOT void filterObjects_data();
+	Q_SLOT void filterObjects();
+
+	/// ParseObject
+	Q_SLOT void setValues_data();
+	Q_SLOT void setValues();
+	Q_SLOT void createdAt_data();
+	Q_SLOT void createdAt();
+
+	/// ParseRows
+	Q_SLOT void readRows_data();
+	Q_SLOT void readRows();
+
+	/// whole requests against the stand-in
+	Q_SLOT void findObjects_data();
+	Q_SLOT void findObjects();
+	Q_SLOT void save_data();
+	Q_SLOT void save();
+	Q_SLOT void wireBytes_data();
+	Q_SLOT void wireBytes();
+
+	static void addRowsAndFields(bool baseline = false); // baseline adds rows of the ParseBaseline code
+	static void addRowsAndSources(const QStringList &sources);
+	static void addDepthsAndWidths();
+	static void addBaseline();
+	static void addFields();
+
+	void seedClass(const QString &className, int rows, int fields);
+
+private:
+	StandinServer *_server;
+	QSet<QString> _seededClasses;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__PARSE_BENCH_HPP_ */
@@ -0,0 +1,252 @@
+/*
+ * ParseBenchNetwork.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "ParseBench.hpp"
+
+#include "StandinServer.hpp"
+#include "ParseObject.hpp"
+#include "ParseQuery.hpp"
+#include "ParseRows.hpp"
+#include "internal/ParseManager.hpp"
+#include "ParseError.hpp"
+#include "ParseJson.hpp"
+
+#include <QtTest/QtTest>
+#include <QtNetwork/QHostAddress>
+#include <QEventLoop>
+#include <QTimer>
+
+#define PQ_BENCH_TIMEOUT	30000
+#define PQ_BENCH_BATCH_SIZE	50 // requests in a batch at most
+#define PQ_BENCH_COMPRESSION_THRESHOLD	1024
+
+namespace parseqt {
+
+/// waits until spy has recorded signal of sender, false on timeout
+static bool waitFor(QSignalSpy *spy, QObject *sender, const char *signal)
+{
+	if (spy->isEmpty()) {
+		QEventLoop loop;
+		QTimer timer;
+		timer.setSingleShot(true);
+		QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+		QObject::connect(sender, signal, &loop, SLOT(quit()));
+		timer.start(PQ_BENCH_TIMEOUT);
+		loop.exec();
+	}
+	return !spy->isEmpty();
+}
+
+/// creates rows objects of fields values on server
+static void seed(StandinServer *server, const QString &className, int rows, int fields)
+{
+	QByteArray path = "/1/classes/" + className.toUtf8();
+	for (int i = 0; i < rows; ++i) {
+		QVariantMap row = ParseBench::jsonRow(i, fields);
+		row.remove("objectId");
+		row.remove("createdAt");
+		row.remove("updatedAt");
+
+		ParseError *error = NULL;
+		QByteArray body = ParseJson::write(row, &error);
+		delete error;
+		server->handle("POST", path, body);
+	}
+}
+
+void ParseBench::seedClass(const QString &className, int rows, int fields)
+{
+	if (!_seededClasses.contains(className)) {
+		_seededClasses.insert(className);
+		seed(_server, className, rows, fields);
+	}
+}
+
+void ParseBench::findObjects_data()
+{
+	addRowsAndFields();
+}
+
+void ParseBench::findObjects()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+
+	QString className = QString("Bench%1x%2").arg(rows).arg(fields);
+	seedClass(className, rows, fields);
+
+	ParseQuery query;
+	query.setClassName(className);
+	query.setLimit(qMin(rows, 1000));
+
+	const char *completed = SIGNAL(findObjectsCompleted(QVariant,parseqt::ParseError*));
+	QSignalSpy spy(&query, completed);
+	QBENCHMARK {
+		spy.clear();
+		query.findObjects();
+		QVERIFY(waitFor(&spy, &query, completed));
+		QVERIFY(!spy.first().at(1).value<ParseError *>());
+
+		foreach (const QVariant &result, spy.first().at(0).toList()) {
+			delete result.value<ParseObject *>();
+		}
+	}
+}
+
+void ParseBench::filterObjects_data()
+{
+	// objects and json rows at hand, and the baseline of querying the server again
+	addRowsAndSources(QStringList() << "objects" << "json" << "baseline");
+}
+
+void ParseBench::filterObjects()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(QString, source);
+
+	QString className = QString("Bench%1x%2").arg(rows).arg(fields);
+	QVariantList jsonRows = jsonDocument(rows, fields).value("results").toList();
+
+	ParseQuery query;
+	query.setClassName(className);
+	addFilter(&query, rows);
+
+	int results = 0;
+	if (source == "objects") {
+		QList<ParseObject *> objects;
+		foreach (const QVariant &object, ParseRows(className, jsonRows).toList()) {
+			objects.append(object.value<ParseObject *>());
+		}
+
+		ParseError *error = NULL;
+		QBENCHMARK {
+			results = query.filterObjects(objects, &error).size();
+		}
+		QVERIFY(!error);
+		qDeleteAll(objects);
+	}
+	else if (source == "json") {
+		QBENCHMARK {
+			results = query.filterObjects(jsonRows).toList().size();
+		}
+	}
+	else {
+		seedClass(className, rows, fields);
+		query.setLazyResults(true);
+
+		const char *completed = SIGNAL(findObjectsCompleted(QVariant,parseqt::ParseError*));
+		QSignalSpy spy(&query, completed);
+		QBENCHMARK {
+			spy.clear();
+			query.findObjects();
+			QVERIFY(waitFor(&spy, &query, completed));
+			QVERIFY(!spy.first().at(1).value<ParseError *>());
+			results = spy.first().at(0).value<ParseRows>().size();
+		}
+	}
+	QCOMPARE(results, filterResults(rows));
+}
+
+void ParseBench::save_data()
+{
+	addFields();
+}
+
+void ParseBench::save()
+{
+	QFETCH(int, fields);
+
+	QVariantMap values = objectValues(0, fields);
+
+	QBENCHMARK {
+		ParseObject object;
+		object.setClassName("BenchSave");
+		for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+			object.setValue(it.key(), it.value());
+		}
+
+		const char *completed = SIGNAL(saveCompleted(bool,parseqt::ParseError*));
+		QSignalSpy spy(&object, completed);
+		object.save();
+		QVERIFY(waitFor(&spy, &object, completed));
+		QVERIFY(spy.first().at(0).toBool());
+	}
+}
+
+void ParseBench::wireBytes_data()
+{
+	addRowsAndFields(true);
+}
+
+void ParseBench::wireBytes()
+{
+	QFETCH(int, rows);
+	QFETCH(int, fields);
+	QFETCH(bool, baseline);
+
+	// a page read and a batch of creates against a server of their own - the baseline server doesn't
+	// compress its replies and the client doesn't compress its requests, as before gzip support
+	StandinServer::Options options;
+	options.gzip = !baseline;
+	StandinServer server(options);
+	QVERIFY(server.listen(QHostAddress::LocalHost, 0));
+
+	QString className = QString("Bench%1x%2").arg(rows).arg(fields);
+	seed(&server, className, rows, fields);
+
+	ParseManager *manager = ParseManager::instance();
+	QUrl serverUrl = manager->serverUrl();
+	int compressionThreshold = manager->compressionThreshold();
+	manager->setServerUrl(QUrl(QString("http://127.0.0.1:%1/1/").arg(server.serverPort())));
+	manager->setCompressionThreshold(baseline ? 0 : PQ_BENCH_COMPRESSION_THRESHOLD);
+	manager->metrics()->reset();
+
+	ParseQuery query;
+	query.setClassName(className);
+	query.setLimit(qMin(rows, 1000));
+	query.setLazyResults(true);
+
+	const char *findCompleted = SIGNAL(findObjectsCompleted(QVariant,parseqt::ParseError*));
+	const char *saveCompleted = SIGNAL(saveCompleted(bool,parseqt::ParseError*));
+	QSignalSpy findSpy(&query, findCompleted);
+	QBENCHMARK {
+		findSpy.clear();
+		query.findObjects();
+		QVERIFY(waitFor(&findSpy, &query, findCompleted));
+		QVERIFY(!findSpy.first().at(1).value<ParseError *>());
+
+		QList<ParseObject *> objects;
+		for (int i = 0; i < qMin(rows, PQ_BENCH_BATCH_SIZE); ++i) {
+			ParseObject *object = new ParseObject;
+			object->setClassName(className);
+			QVariantMap values = objectValues(i, fields);
+			for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+				object->setValue(it.key(), it.value());
+			}
+			objects.append(object);
+		}
+
+		// the objects of a batch complete together
+		QSignalSpy saveSpy(objects.last(), saveCompleted);
+		ParseObject::saveAll(objects);
+		QVERIFY(waitFor(&saveSpy, objects.last(), saveCompleted));
+		QVERIFY(saveSpy.first().at(0).toBool());
+		qDeleteAll(objects);
+	}
+
+	// the metrics of a reply are recorded when it is deleted
+	QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+	QVariantMap metrics = manager->metrics()->toVariant();
+	qDebug() << "bytes per page reply:" << metrics.value("GET " + className).toMap().value("responseBytes").toMap().value("mean").toDouble()
+			 << "per batch request:" << metrics.value("POST batch").toMap().value("requestBytes").toMap().value("mean").toDouble();
+
+	manager->setServerUrl(serverUrl);
+	manager->setCompressionThreshold(compressionThreshold);
+}
+
+} /* namespace parseqt */
@@ -0,0 +1,52 @@
+TEMPLATE = app
+TARGET = bench
+
+QT = core network sql declarative testlib
+CONFIG += console warn_on
+CONFIG -= app_bundle
+
+LIBS += -lz
+
+# qmake CONFIG+=cascades builds the same suite against the JsonDataAccess backend, as the
+# baseline of the linux ParseJson
+cascades {
+    PARSEQT_PLATFORM = cascades
+    LIBS += -lbbdata
+}
+
+include(../../tools/standin/standin.pri)
+
+SOURCES += ParseBench.cpp \
+           ParseBenchNetwork.cpp \
+           ParseBaseline.cpp \
+           $$PARSEQT/common/Parse.cpp \
+           $$PARSEQT/common/ParseObject.cpp \
+           $$PARSEQT/common/ParseQuery.cpp \
+           $$PARSEQT/common/ParseQueryModel.cpp \
+           $$PARSEQT/common/ParseRows.cpp \
+           $$PARSEQT/common/internal/ParseBatch.cpp \
+           $$PARSEQT/common/internal/ParseCache.cpp \
+           $$PARSEQT/common/internal/ParseJournal.cpp \
+           $$PARSEQT/common/internal/ParseLocalStore.cpp \
+           $$PARSEQT/common/internal/ParseManager.cpp \
+           $$PARSEQT/common/internal/ParseMetrics.cpp \
+           $$PARSEQT/common/internal/ParseQueryEvaluator.cpp \
+           $$PARSEQT/common/internal/ParseScheduler.cpp \
+           $$PARSEQT/common/internal/ParseStreamReader.cpp
+
+HEADERS += ParseBench.hpp \
+           ParseBaseline.hpp \
+           $$PARSEQT/common/Parse.hpp \
+           $$PARSEQT/common/ParseObject.hpp \
+           $$PARSEQT/common/ParseQuery.hpp \
+           $$PARSEQT/common/ParseQueryModel.hpp \
+           $$PARSEQT/common/ParseRows.hpp \
+           $$PARSEQT/common/internal/ParseBatch.hpp \
+           $$PARSEQT/common/internal/ParseCache.hpp \
+           $$PARSEQT/common/internal/ParseJournal.hpp \
+           $$PARSEQT/common/internal/ParseLocalStore.hpp \
+           $$PARSEQT/common/internal/ParseManager.hpp \
+           $$PARSEQT/common/internal/ParseMetrics.hpp \
+           $$PARSEQT/common/internal/ParseQueryEvaluator.hpp \
+           $$PARSEQT/common/internal/ParseScheduler.hpp \
+           $$PARSEQT/common/internal/ParseStreamReader.hpp
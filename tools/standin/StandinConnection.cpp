@@ -0,0 +1,191 @@
+/*
+ * StandinConnection.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "StandinConnection.hpp"
+
+#include "StandinServer.hpp"
+#include "ParseCompression.hpp"
+
+#define PQ_STANDIN_BANDWIDTH_INTERVAL	100 // ms between writes when throttling to a bandwidth
+
+namespace parseqt {
+
+static QByteArray reasonPhrase(int status)
+{
+	switch (status) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 429: return "Too Many Requests";
+	case 500: return "Internal Server Error";
+	case 502: return "Bad Gateway";
+	case 503: return "Service Unavailable";
+	default: return "Unknown";
+	}
+}
+
+StandinConnection::StandinConnection(int socketDescriptor, StandinServer *server)
+	: QObject(server), _server(server), _responding(false), _contentLength(0), _headerComplete(false),
+	  _acceptsGzip(false), _gzipBody(false), _close(false)
+{
+	_socket.setSocketDescriptor(socketDescriptor);
+
+	connect(&_socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+	connect(&_socket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+	connect(&_writeTimer, SIGNAL(timeout()), this, SLOT(writeBody()));
+}
+
+StandinConnection::~StandinConnection() { }
+
+void StandinConnection::readRequest()
+{
+	_buffer.append(_socket.readAll());
+
+	// requests on the same connection are answered in order
+	if (_responding) {
+		return;
+	}
+
+	if (!_headerComplete && !parseHeader()) {
+		return;
+	}
+	if (_buffer.size() < _contentLength) {
+		return;
+	}
+
+	_body = _buffer.left(_contentLength);
+	_buffer.remove(0, _contentLength);
+	if (_gzipBody) {
+		QByteArray inflated;
+		ParseInflater::inflateAll(_body, &inflated);
+		_body = inflated;
+	}
+
+	_responding = true;
+
+	const StandinServer::Options &options = _server->options();
+	int delay = options.latency + (options.jitter > 0 ? qrand() % (options.jitter + 1) : 0);
+	QTimer::singleShot(delay, this, SLOT(respond()));
+}
+
+bool StandinConnection::parseHeader()
+{
+	int end = _buffer.indexOf("\r\n\r\n");
+	if (end < 0) {
+		return false;
+	}
+
+	QList<QByteArray> lines = _buffer.left(end).split('\n');
+	_buffer.remove(0, end + 4);
+
+	QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+	_method = requestLine.value(0);
+	_path = requestLine.value(1);
+	_contentLength = 0;
+	_acceptsGzip = false;
+	_gzipBody = false;
+	_close = false;
+
+	foreach (const QByteArray &line, lines) {
+		int colon = line.indexOf(':');
+		if (colon < 0) {
+			continue;
+		}
+		QByteArray name = line.left(colon).trimmed().toLower();
+		QByteArray value = line.mid(colon + 1).trimmed();
+
+		if (name == "content-length") {
+			_contentLength = value.toInt();
+		}
+		else if (name == "accept-encoding") {
+			_acceptsGzip = value.contains("gzip");
+		}
+		else if (name == "content-encoding") {
+			_gzipBody = value.toLower() == "gzip";
+		}
+		else if (name == "connection") {
+			_close = value.toLower() == "close";
+		}
+	}
+
+	_headerComplete = true;
+	return true;
+}
+
+void StandinConnection::respond()
+{
+	StandinServer::Response response = _server->handle(_method, _path, _body);
+	writeResponse(response.status, response.body);
+}
+
+void StandinConnection::writeResponse(int status, const QByteArray &body)
+{
+	QByteArray content = body;
+	bool gzip = _acceptsGzip && _server->options().gzip;
+	if (gzip) {
+		content = gzipCompress(body);
+	}
+
+	QByteArray header;
+	header.append("HTTP/1.1 " + QByteArray::number(status) + " " + reasonPhrase(status) + "\r\n");
+	header.append("Content-Type: application/json; charset=utf-8\r\n");
+	header.append("Content-Length: " + QByteArray::number(content.size()) + "\r\n");
+	if (gzip) {
+		header.append("Content-Encoding: gzip\r\n");
+	}
+	header.append(_close ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+	header.append("\r\n");
+
+	_socket.write(header);
+	_pending = content;
+
+	const StandinServer::Options &options = _server->options();
+	if (options.dripSize > 0) {
+		_writeTimer.start(options.dripInterval);
+	}
+	else if (options.bandwidth > 0) {
+		_writeTimer.start(PQ_STANDIN_BANDWIDTH_INTERVAL);
+	}
+	writeBody();
+}
+
+void StandinConnection::writeBody()
+{
+	const StandinServer::Options &options = _server->options();
+
+	int chunkSize = _pending.size();
+	if (options.dripSize > 0) {
+		chunkSize = options.dripSize;
+	}
+	else if (options.bandwidth > 0) {
+		chunkSize = qMax(1, options.bandwidth * PQ_STANDIN_BANDWIDTH_INTERVAL / 1000);
+	}
+
+	_socket.write(_pending.left(chunkSize));
+	_pending.remove(0, qMin(chunkSize, _pending.size()));
+
+	if (!_pending.isEmpty()) {
+		return;
+	}
+
+	// the reply is complete, go on with the next request
+	_writeTimer.stop();
+	_responding = false;
+	_headerComplete = false;
+
+	if (_close) {
+		_socket.disconnectFromHost();
+		return;
+	}
+	if (!_buffer.isEmpty()) {
+		QTimer::singleShot(0, this, SLOT(readRequest()));
+	}
+}
+
+} /* namespace parseqt */
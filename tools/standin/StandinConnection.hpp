@@ -0,0 +1,62 @@
+/*
+ * StandinConnection.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__STANDIN_CONNECTION_HPP_
+#define PARSEQT__STANDIN_CONNECTION_HPP_
+
+#include <QtNetwork/QTcpSocket>
+#include <QTimer>
+
+namespace parseqt {
+
+class StandinServer;
+
+/// One keep-alive HTTP/1.1 connection of the stand-in server. Requests are answered one after the
+/// other, each reply is delayed and written out at the pace configured in the server's options.
+
+class StandinConnection : public QObject {
+	Q_OBJECT
+
+public:
+	StandinConnection(int socketDescriptor, StandinServer *server);
+	virtual ~StandinConnection();
+
+private:
+	Q_DISABLE_COPY(StandinConnection)
+
+	Q_SLOT void readRequest();
+	Q_SLOT void respond();
+	Q_SLOT void writeBody();
+
+	bool parseHeader();
+	void writeResponse(int status, const QByteArray &body);
+
+private:
+	StandinServer *_server;
+	QTcpSocket _socket;
+	QTimer _writeTimer;
+
+	QByteArray _buffer;
+	bool _responding;
+
+	// the request being handled
+	QByteArray _method;
+	QByteArray _path;
+	QByteArray _body;
+	int _contentLength;
+	bool _headerComplete;
+	bool _acceptsGzip;
+	bool _gzipBody;
+	bool _close;
+
+	// the part of the reply body still to be written
+	QByteArray _pending;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__STANDIN_CONNECTION_HPP_ */
@@ -0,0 +1,476 @@
+/*
+ * StandinServer.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "StandinServer.hpp"
+
+#include "StandinConnection.hpp"
+#include "ParseError.hpp"
+#include "ParseJson.hpp"
+
+#include <QDateTime>
+#include <QStringList>
+#include <QUrl>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <string.h>
+
+#define PQ_STANDIN_API_PREFIX	"/1/"
+#define PQ_STANDIN_DEFAULT_LIMIT	100
+#define PQ_STANDIN_MAX_LIMIT	1000
+#define PQ_STANDIN_DATETIME_FORMAT	"yyyy-MM-ddTHH:mm:ss.zzzZ"
+
+namespace parseqt {
+
+static QString currentTimestamp()
+{
+	return QDateTime::currentDateTime().toUTC().toString(PQ_STANDIN_DATETIME_FORMAT);
+}
+
+static QString newObjectId()
+{
+	static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+	QString result;
+	for (int i = 0; i < 10; ++i) {
+		result.append(QChar(chars[qrand() % (sizeof(chars) - 1)]));
+	}
+	return result;
+}
+
+/// values are compared like Parse does - dates by their iso string, numbers as numbers
+
+static QVariant comparable(const QVariant &value)
+{
+	if (value.type() == QVariant::Map) {
+		QVariantMap map = value.toMap();
+		if (map.value("__type") == "Date") {
+			return map.value("iso");
+		}
+	}
+	return value;
+}
+
+static bool isNumber(const QVariant &value)
+{
+	switch (value.type()) {
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+	case QVariant::Double:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool compareValues(const QVariant &a, const QVariant &b, int *result)
+{
+	QVariant left = comparable(a);
+	QVariant right = comparable(b);
+
+	if (isNumber(left) && isNumber(right)) {
+		double difference = left.toDouble() - right.toDouble();
+		*result = difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+		return true;
+	}
+	if (left.type() == QVariant::String && right.type() == QVariant::String) {
+		*result = QString::compare(left.toString(), right.toString());
+		return true;
+	}
+	if (left.type() == QVariant::Bool && right.type() == QVariant::Bool) {
+		*result = int(left.toBool()) - int(right.toBool());
+		return true;
+	}
+	return false;
+}
+
+static bool equalValues(const QVariant &a, const QVariant &b)
+{
+	int result;
+	if (compareValues(a, b, &result)) {
+		return result == 0;
+	}
+	return a == b;
+}
+
+static bool containsValue(const QVariant &list, const QVariant &value)
+{
+	foreach (const QVariant &entry, list.toList()) {
+		if (equalValues(entry, value)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool matchesConstraint(const QVariantMap &object, const QString &key, const QVariant &constraint)
+{
+	bool exists = object.contains(key);
+	QVariant value = object.value(key);
+
+	QVariantMap operators = constraint.toMap();
+	if (constraint.type() != QVariant::Map || operators.contains("__type")) {
+		return exists && equalValues(value, constraint);
+	}
+
+	for (QVariantMap::const_iterator i = operators.constBegin(); i != operators.constEnd(); ++i) {
+		const QString &op = i.key();
+		int result = 0;
+
+		if (op == "$exists") {
+			if (exists != i.value().toBool()) {
+				return false;
+			}
+		}
+		else if (op == "$ne") {
+			if (exists && equalValues(value, i.value())) {
+				return false;
+			}
+		}
+		else if (op == "$in") {
+			if (!exists || !containsValue(i.value(), value)) {
+				return false;
+			}
+		}
+		else if (op == "$nin") {
+			if (exists && containsValue(i.value(), value)) {
+				return false;
+			}
+		}
+		else if (!exists || !compareValues(value, i.value(), &result)) {
+			return false;
+		}
+		else if ((op == "$lt" && !(result < 0)) || (op == "$lte" && !(result <= 0))
+				|| (op == "$gt" && !(result > 0)) || (op == "$gte" && !(result >= 0))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool matches(const QVariantMap &object, const QVariantMap &where)
+{
+	for (QVariantMap::const_iterator i = where.constBegin(); i != where.constEnd(); ++i) {
+		if (!matchesConstraint(object, i.key(), i.value())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+class OrderLessThan {
+public:
+	explicit OrderLessThan(const QStringList &order) : _order(order) { }
+
+	bool operator()(const QVariantMap &a, const QVariantMap &b) const
+	{
+		foreach (QString key, _order) {
+			bool descending = key.startsWith('-');
+			if (descending) {
+				key.remove(0, 1);
+			}
+
+			int result = 0;
+			if (!compareValues(a.value(key), b.value(key), &result)) {
+				// objects lacking the key sort first
+				result = int(a.contains(key)) - int(b.contains(key));
+			}
+			if (result != 0) {
+				return descending ? result > 0 : result < 0;
+			}
+		}
+		return false;
+	}
+
+private:
+	QStringList _order;
+};
+
+static QVariantMap selectKeys(const QVariantMap &object, const QStringList &keys)
+{
+	if (keys.isEmpty()) {
+		return object;
+	}
+
+	QVariantMap result;
+	result.insert("objectId", object.value("objectId"));
+	result.insert("createdAt", object.value("createdAt"));
+	result.insert("updatedAt", object.value("updatedAt"));
+	foreach (const QString &key, keys) {
+		if (object.contains(key)) {
+			result.insert(key, object.value(key));
+		}
+	}
+	return result;
+}
+
+static void applyFields(QVariantMap *object, const QVariantMap &fields)
+{
+	for (QVariantMap::const_iterator i = fields.constBegin(); i != fields.constEnd(); ++i) {
+		QVariantMap op = i.value().toMap();
+		QString opName = op.value("__op").toString();
+
+		if (opName == "Delete") {
+			object->remove(i.key());
+		}
+		else if (opName == "Increment") {
+			object->insert(i.key(), object->value(i.key()).toDouble() + op.value("amount").toDouble());
+		}
+		else {
+			object->insert(i.key(), i.value());
+		}
+	}
+}
+
+///
+
+StandinServer::Options::Options()
+	: latency(0), jitter(0), bandwidth(0), dripSize(0), dripInterval(100), errorRate(0), errorStatus(500),
+	  gzip(true), verbose(false)
+{
+}
+
+StandinServer::StandinServer(const Options &options, QObject *parent) : QTcpServer(parent), _options(options) { }
+
+StandinServer::~StandinServer() { }
+
+const StandinServer::Options &StandinServer::options() const
+{
+	return _options;
+}
+
+void StandinServer::incomingConnection(int socketDescriptor)
+{
+	new StandinConnection(socketDescriptor, this);
+}
+
+StandinServer::Response StandinServer::handle(const QByteArray &method, const QByteArray &path, const QByteArray &body)
+{
+	Response response;
+	response.status = 200;
+
+	if (_options.verbose) {
+		qDebug() << method << path << body.size();
+	}
+
+	QVariant json;
+	if (_options.errorRate > 0 && qrand() < _options.errorRate * RAND_MAX) {
+		response.status = _options.errorStatus;
+		json = error(response.status == 429 ? ParseError::ParseCodeRequestLimitExceeded : ParseError::ParseCodeInternalServerError,
+					 "injected failure", &response.status, _options.errorStatus);
+	}
+	else {
+		QVariant bodyJson;
+		ParseError *parseError = NULL;
+		if (!body.isEmpty()) {
+			bodyJson = ParseJson::read(body, &parseError);
+		}
+
+		if (parseError) {
+			json = error(107, "invalid JSON", &response.status, 400);
+			delete parseError;
+		}
+		else {
+			json = route(method, path, bodyJson, &response.status);
+		}
+	}
+
+	ParseError *writeError = NULL;
+	response.body = ParseJson::write(json, &writeError);
+	delete writeError;
+
+	return response;
+}
+
+QVariant StandinServer::route(const QString &method, const QString &path, const QVariant &body, int *status)
+{
+	QUrl url = QUrl::fromEncoded(path.toUtf8());
+	QString resource = url.path();
+
+	if (!resource.startsWith(PQ_STANDIN_API_PREFIX)) {
+		return error(ParseError::ParseCodeObjectNotFound, "unknown path", status, 404);
+	}
+	QStringList parts = resource.mid(strlen(PQ_STANDIN_API_PREFIX)).split('/', QString::SkipEmptyParts);
+
+	if (parts.size() == 1 && parts.at(0) == "batch" && method == "POST") {
+		return batch(body.toMap(), status);
+	}
+
+	if (parts.isEmpty() || parts.at(0) != "classes" || parts.size() < 2 || parts.size() > 3) {
+		return error(ParseError::ParseCodeObjectNotFound, "unknown path", status, 404);
+	}
+
+	const QString &className = parts.at(1);
+
+	QHash<QString, QString> params;
+	typedef QPair<QString, QString> QueryItem;
+	foreach (const QueryItem &item, url.queryItems()) {
+		params.insert(item.first, item.second);
+	}
+
+	if (parts.size() == 2) {
+		if (method == "POST") {
+			return createObject(className, body.toMap(), status);
+		}
+		if (method == "GET") {
+			return findObjects(className, params, status);
+		}
+	}
+	else {
+		const QString &objectId = parts.at(2);
+		if (method == "GET") {
+			return getObject(className, objectId, params.value("keys").split(',', QString::SkipEmptyParts), status);
+		}
+		if (method == "PUT") {
+			return updateObject(className, objectId, body.toMap(), status);
+		}
+		if (method == "DELETE") {
+			return eraseObject(className, objectId, status);
+		}
+	}
+
+	return error(ParseError::ParseCodeObjectNotFound, "unsupported method", status, 405);
+}
+
+QVariant StandinServer::createObject(const QString &className, const QVariantMap &body, int *status)
+{
+	QVariantMap object;
+	applyFields(&object, body);
+
+	QString objectId = newObjectId();
+	QString now = currentTimestamp();
+	object.insert("objectId", objectId);
+	object.insert("createdAt", now);
+	object.insert("updatedAt", now);
+
+	_classes[className].insert(objectId, object);
+
+	QVariantMap result;
+	result.insert("objectId", objectId);
+	result.insert("createdAt", now);
+
+	*status = 201;
+	return result;
+}
+
+QVariant StandinServer::getObject(const QString &className, const QString &objectId, const QStringList &keys, int *status)
+{
+	const QMap<QString, QVariantMap> &objects = _classes[className];
+	QMap<QString, QVariantMap>::const_iterator i = objects.constFind(objectId);
+	if (i == objects.constEnd()) {
+		return error(ParseError::ParseCodeObjectNotFound, "object not found for get", status, 404);
+	}
+
+	return selectKeys(i.value(), keys);
+}
+
+QVariant StandinServer::updateObject(const QString &className, const QString &objectId, const QVariantMap &body, int *status)
+{
+	QMap<QString, QVariantMap> &objects = _classes[className];
+	QMap<QString, QVariantMap>::iterator i = objects.find(objectId);
+	if (i == objects.end()) {
+		return error(ParseError::ParseCodeObjectNotFound, "object not found for update", status, 404);
+	}
+
+	QString now = currentTimestamp();
+	applyFields(&i.value(), body);
+	i.value().insert("updatedAt", now);
+
+	QVariantMap result;
+	result.insert("updatedAt", now);
+	return result;
+}
+
+QVariant StandinServer::eraseObject(const QString &className, const QString &objectId, int *status)
+{
+	if (!_classes[className].remove(objectId)) {
+		return error(ParseError::ParseCodeObjectNotFound, "object not found for delete", status, 404);
+	}
+	return QVariantMap();
+}
+
+QVariant StandinServer::findObjects(const QString &className, const QHash<QString, QString> &params, int *status)
+{
+	QVariantMap where;
+	if (params.contains("where")) {
+		ParseError *parseError = NULL;
+		where = ParseJson::read(params.value("where").toUtf8(), &parseError).toMap();
+		if (parseError) {
+			delete parseError;
+			return error(107, "invalid where", status, 400);
+		}
+	}
+
+	QList<QVariantMap> results;
+	foreach (const QVariantMap &object, _classes.value(className)) {
+		if (matches(object, where)) {
+			results.append(object);
+		}
+	}
+
+	QStringList order = params.value("order").split(',', QString::SkipEmptyParts);
+	if (!order.isEmpty()) {
+		std::stable_sort(results.begin(), results.end(), OrderLessThan(order));
+	}
+
+	int count = results.size();
+	int skip = qMax(0, params.value("skip").toInt());
+	int limit = params.contains("limit") ? params.value("limit").toInt() : PQ_STANDIN_DEFAULT_LIMIT;
+	limit = qBound(0, limit, PQ_STANDIN_MAX_LIMIT);
+	QStringList keys = params.value("keys").split(',', QString::SkipEmptyParts);
+
+	QVariantList page;
+	for (int i = skip; i < results.size() && page.size() < limit; ++i) {
+		page.append(selectKeys(results.at(i), keys));
+	}
+
+	QVariantMap result;
+	result.insert("results", page);
+	if (params.value("count") == "1") {
+		result.insert("count", count);
+	}
+	return result;
+}
+
+QVariant StandinServer::batch(const QVariantMap &body, int *status)
+{
+	QVariantList requests = body.value("requests").toList();
+	if (requests.size() > 50) {
+		return error(107, "too many operations in batch", status, 400);
+	}
+
+	QVariantList results;
+	foreach (const QVariant &request, requests) {
+		QVariantMap requestMap = request.toMap();
+
+		int requestStatus = 200;
+		QVariant json = route(requestMap.value("method").toString(), requestMap.value("path").toString(),
+							  requestMap.value("body"), &requestStatus);
+
+		QVariantMap result;
+		result.insert(requestStatus < 400 ? "success" : "error", json);
+		results.append(result);
+	}
+
+	return results;
+}
+
+QVariant StandinServer::error(int code, const QString &message, int *status, int httpStatus)
+{
+	*status = httpStatus;
+
+	QVariantMap result;
+	result.insert("code", code);
+	result.insert("error", message);
+	return result;
+}
+
+} /* namespace parseqt */
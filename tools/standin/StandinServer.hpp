@@ -0,0 +1,77 @@
+/*
+ * StandinServer.hpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#ifndef PARSEQT__STANDIN_SERVER_HPP_
+#define PARSEQT__STANDIN_SERVER_HPP_
+
+#include <QtNetwork/QTcpServer>
+#include <QHash>
+#include <QMap>
+#include <QVariant>
+
+namespace parseqt {
+
+/// Local stand-in for the Parse REST API - keeps objects in memory and implements the classes,
+/// query and batch endpoints used by parseqt. Replies can be delayed, throttled, drip-fed or
+/// replaced by errors to see how the client behaves under bad network conditions.
+
+class StandinServer : public QTcpServer {
+	Q_OBJECT
+
+public:
+	struct Options {
+		Options();
+
+		int latency; // ms before a reply is started
+		int jitter; // ms randomly added to the latency
+		int bandwidth; // bytes per second, 0 is unlimited
+		int dripSize; // when set, bodies are written in chunks of this many bytes ...
+		int dripInterval; // ... every this many ms
+		double errorRate; // share of requests answered with errorStatus, from 0 to 1
+		int errorStatus;
+		bool gzip; // compress replies to clients accepting gzip
+		bool verbose;
+	};
+
+	struct Response {
+		int status;
+		QByteArray body;
+	};
+
+	explicit StandinServer(const Options &options, QObject *parent = 0);
+	virtual ~StandinServer();
+
+	const Options &options() const;
+
+	/// handles a request for path (with query) relative to the server root
+	Response handle(const QByteArray &method, const QByteArray &path, const QByteArray &body);
+
+protected:
+	virtual void incomingConnection(int socketDescriptor);
+
+private:
+	Q_DISABLE_COPY(StandinServer)
+
+	QVariant route(const QString &method, const QString &path, const QVariant &body, int *status);
+
+	QVariant createObject(const QString &className, const QVariantMap &body, int *status);
+	QVariant getObject(const QString &className, const QString &objectId, const QStringList &keys, int *status);
+	QVariant updateObject(const QString &className, const QString &objectId, const QVariantMap &body, int *status);
+	QVariant eraseObject(const QString &className, const QString &objectId, int *status);
+	QVariant findObjects(const QString &className, const QHash<QString, QString> &params, int *status);
+	QVariant batch(const QVariantMap &body, int *status);
+
+	static QVariant error(int code, const QString &message, int *status, int httpStatus);
+
+private:
+	Options _options;
+	QHash<QString, QMap<QString, QVariantMap> > _classes;
+};
+
+} /* namespace parseqt */
+
+#endif /* PARSEQT__STANDIN_SERVER_HPP_ */
@@ -0,0 +1,102 @@
+/*
+ * main.cpp
+ *
+ * Copyright (c) 2013, Framework Labs
+ *
+ */
+
+#include "StandinServer.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QStringList>
+
+#include <stdio.h>
+
+using namespace parseqt;
+
+static void usage()
+{
+	fprintf(stderr,
+			"usage: standin [options]\n"
+			"  --port <n>            port to listen on (default 8080)\n"
+			"  --latency <ms>        delay before each reply\n"
+			"  --jitter <ms>         random extra delay up to this value\n"
+			"  --bandwidth <bytes/s> throttle reply bodies\n"
+			"  --drip <bytes>        write reply bodies in chunks of this size ...\n"
+			"  --drip-interval <ms>  ... this far apart (default 100)\n"
+			"  --error-rate <0..1>   share of requests failing with --error-status\n"
+			"  --error-status <code> http status of injected failures (default 500)\n"
+			"  --no-gzip             never compress replies\n"
+			"  --verbose             log requests\n"
+			"point Parse.serverUrl to http://localhost:<port>/1/\n");
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+
+	QStringList args = app.arguments();
+	args.removeFirst();
+
+	StandinServer::Options options;
+	quint16 port = 8080;
+
+	while (!args.isEmpty()) {
+		QString arg = args.takeFirst();
+
+		if (arg == "--no-gzip") {
+			options.gzip = false;
+			continue;
+		}
+		if (arg == "--verbose") {
+			options.verbose = true;
+			continue;
+		}
+		if (args.isEmpty()) {
+			usage();
+			return 1;
+		}
+
+		QString value = args.takeFirst();
+		if (arg == "--port") {
+			port = value.toUShort();
+		}
+		else if (arg == "--latency") {
+			options.latency = value.toInt();
+		}
+		else if (arg == "--jitter") {
+			options.jitter = value.toInt();
+		}
+		else if (arg == "--bandwidth") {
+			options.bandwidth = value.toInt();
+		}
+		else if (arg == "--drip") {
+			options.dripSize = value.toInt();
+		}
+		else if (arg == "--drip-interval") {
+			options.dripInterval = value.toInt();
+		}
+		else if (arg == "--error-rate") {
+			options.errorRate = value.toDouble();
+		}
+		else if (arg == "--error-status") {
+			options.errorStatus = value.toInt();
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	qsrand(QDateTime::currentDateTime().toTime_t());
+
+	StandinServer server(options);
+	if (!server.listen(QHostAddress::Any, port)) {
+		fprintf(stderr, "standin: %s\n", qPrintable(server.errorString()));
+		return 1;
+	}
+	fprintf(stderr, "standin: listening on port %d\n", server.serverPort());
+
+	return app.exec();
+}
@@ -0,0 +1,21 @@
+# Sources of the stand-in server, shared with the benchmarks which run it in-process.
+# PARSEQT_PLATFORM selects the ParseJson backend, linux unless set before including.
+
+STANDIN = $$PWD
+PARSEQT = $$PWD/../../src
+
+isEmpty(PARSEQT_PLATFORM): PARSEQT_PLATFORM = linux
+
+INCLUDEPATH += $$STANDIN $$PARSEQT/common $$PARSEQT/common/internal $$PARSEQT/platform/$$PARSEQT_PLATFORM
+
+SOURCES += $$STANDIN/StandinConnection.cpp \
+           $$STANDIN/StandinServer.cpp \
+           $$PARSEQT/common/ParseError.cpp \
+           $$PARSEQT/common/internal/ParseCompression.cpp \
+           $$PARSEQT/platform/$$PARSEQT_PLATFORM/ParseJson.cpp
+
+HEADERS += $$STANDIN/StandinConnection.hpp \
+           $$STANDIN/StandinServer.hpp \
+           $$PARSEQT/common/ParseError.hpp \
+           $$PARSEQT/common/internal/ParseCompression.hpp \
+           $$PARSEQT/platform/$$PARSEQT_PLATFORM/ParseJson.hpp
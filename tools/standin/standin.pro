@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = standin
+
+QT = core network
+CONFIG += console warn_on
+CONFIG -= app_bundle
+
+LIBS += -lz
+
+include(standin.pri)
+
+SOURCES += main.cpp